@@ -301,6 +301,7 @@ PRODUCT_PACKAGES += \
     android.hardware.power@1.2.vendor 
 
 PRODUCT_COPY_FILES += \
+    $(LOCAL_PATH)/power/configs/power_profiles.conf:$(TARGET_COPY_OUT_VENDOR)/etc/power_profiles.conf \
     $(LOCAL_PATH)/power/configs/powerhint.xml:$(TARGET_COPY_OUT_VENDOR)/etc/powerhint.xml
 
 # Properties
@@ -20,22 +20,19 @@
 #include "Lights.h"
 #include <log/log.h>
 #include <android-base/logging.h>
-#include <fstream>
 
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace light {
 
-/*
- * Write value to path and close file.
- */
-template <typename T>
-static void set(const std::string& path, const T& value) {
-    std::ofstream file(path);
-    file << value;
-}
+using ::android::hardware::light::colorToBrightness;
+using ::android::hardware::light::LockHoldTimer;
+
+static constexpr const char* kLedDir = "/sys/class/leds/white";
+static constexpr const char* kBacklightDir = "/sys/class/backlight/panel0-backlight";
 
+// brightness of a full white color
 static constexpr uint32_t kBrightnessNoBlink = 90;
 
 const static std::map<LightType, int> kSupportedLights = {
@@ -45,7 +42,17 @@ const static std::map<LightType, int> kSupportedLights = {
     {LightType::ATTENTION, 0}
 };
 
-Lights::Lights() {
+static uint32_t rgbToBrightness(const HwLightState& state) {
+    uint32_t color = state.color & 0x00ffffff;
+    return ((77 * ((color >> 16) & 0xff)) + (150 * ((color >> 8) & 0xff)) +
+            (29 * (color & 0xff))) >> 8;
+}
+
+Lights::Lights() : Lights(kLedDir, kBacklightDir) {
+}
+
+Lights::Lights(const std::string& ledDir, const std::string& backlightDir)
+    : mLed(ledDir), mBacklight(backlightDir) {
     // int lightCount = 0;
     for (auto const &pair : kSupportedLights) {
         LightType type = pair.first;
@@ -57,46 +64,93 @@ Lights::Lights() {
         mLights[hwLight.id] = priority;
         mAvailableLights.emplace_back(hwLight);
     }
+
+    mWriter = std::thread(&Lights::writerLoop, this);
+}
+
+Lights::~Lights() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCond.notify_one();
+    mWriter.join();
+}
+
+/*
+ * The sysfs writes are slow PMIC transactions, so they are done here rather
+ * than on the binder thread. The writer only ever applies the latest
+ * arbitrated state; states superseded while a write is in flight are dropped.
+ */
+void Lights::writerLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    for (;;) {
+        mCond.wait(lock, [this] { return mPending || mExit; });
+        if (mExit)
+            return;
+        mPending = false;
+
+        // choose HwLightState in the order of priority
+        HwLightState stateToUse;
+        {
+            LockHoldTimer timer(&mLockStats);
+
+            stateToUse = mHwLightStates.front();
+            for (const auto& itState : mHwLightStates) {
+                if (itState.color & 0xffffff) {
+                    stateToUse = itState;
+                    break;
+                }
+            }
+        }
+
+        lock.unlock();
+        writeState(stateToUse);
+        lock.lock();
+    }
+}
+
+void Lights::writeState(const HwLightState& state) {
+    uint32_t onMs = state.flashMode != FlashMode::NONE ? state.flashOnMs : 0;
+    uint32_t offMs = state.flashMode != FlashMode::NONE ? state.flashOffMs : 0;
+    ::android::hardware::light::LedState ledState = {};
+
+    ledState.brightness = colorToBrightness(state.color, kBrightnessNoBlink);
+    if (ledState.brightness > 0 && onMs > 0 && offMs > 0) {
+        // hardware flashing is a breathing pattern
+        ledState.program = mCompiler.compile({
+            .brightness = ledState.brightness,
+            .onMs = onMs,
+            .offMs = offMs,
+            .breathe = state.flashMode == FlashMode::HARDWARE,
+        });
+    }
+
+    mLed.setState(ledState);
 }
 
 ndk::ScopedAStatus Lights::setLightState(int id, const HwLightState& state) {
-    ALOGI("setLightState id=%d", id);
     auto it = mLights.find(id);
     if (it == mLights.end()) {
         ALOGE("Light not supported");
         return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
+    // brightness animations set the backlight every frame, don't log them
     if (id == (int)LightType::BACKLIGHT) {
-        ALOGD("Do nothing for screen backlight brightness.");
+        mBacklight.setBrightness(rgbToBrightness(state));
         return ndk::ScopedAStatus::ok();
     }
 
-    std::lock_guard<std::mutex> lock(mLock);
-
-    mHwLightStates.at(mLights[id]) = state;
-    uint32_t whiteBrightness = 0;
-    // choose HwLightState in the order of priority
-    HwLightState stateToUse = mHwLightStates.front();
-    for (const auto& itState : mHwLightStates) {
-        if (itState.color & 0xffffff) {
-            stateToUse = itState;
-            whiteBrightness = kBrightnessNoBlink;
-            break;
-        }
-    }
-
-    uint32_t onMs = stateToUse.flashMode == FlashMode::TIMED ? stateToUse.flashOnMs : 0;
-    uint32_t offMs = stateToUse.flashMode == FlashMode::TIMED ? stateToUse.flashOffMs : 0;
-
-    // Disable blinking to start
-    set("/sys/class/leds/white/blink", 0);
+    ALOGI("setLightState id=%d", id);
 
-    if (onMs > 0 && offMs > 0) {
-        // Start blinking
-        set("/sys/class/leds/white/blink", 1);
-    } else {
-        set("/sys/class/leds/white/brightness", whiteBrightness);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        LockHoldTimer timer(&mLockStats);
+        mHwLightStates.at(mLights[id]) = state;
+        mPending = true;
     }
+    mCond.notify_one();
 
     return ndk::ScopedAStatus::ok();
 }
@@ -20,7 +20,13 @@
 #include <aidl/android/hardware/light/BnLights.h>
 #include <hardware/hardware.h>
 #include <hardware/lights.h>
+#include <condition_variable>
 #include <map>
+#include <thread>
+
+#include "Backlight.h"
+#include "LedDevice.h"
+#include "LockStats.h"
 
 namespace aidl {
 namespace android {
@@ -30,11 +36,28 @@ namespace light {
 class Lights : public BnLights {
     public:
       Lights();
+      Lights(const std::string& ledDir, const std::string& backlightDir);
+      ~Lights();
       ndk::ScopedAStatus setLightState(int id, const HwLightState& state) override;
       ndk::ScopedAStatus getLights(std::vector<HwLight>* types) override;
+      const ::android::hardware::light::LockStats& lockStats() const { return mLockStats; }
 
     private:
+      void writerLoop();
+      void writeState(const HwLightState& state);
+
+      // only touched by the writer thread
+      ::android::hardware::light::LedDevice mLed;
+      ::android::hardware::light::LedPatternCompiler mCompiler;
+      ::android::hardware::light::Backlight mBacklight;
+
       std::mutex mLock;
+      ::android::hardware::light::LockStats mLockStats;
+      // signals the writer thread that mHwLightStates changed
+      std::condition_variable mCond;
+      bool mPending = false;
+      bool mExit = false;
+      std::thread mWriter;
       // a map of <id, priority>
       std::map<int, int> mLights;
       std::vector<HwLight> mAvailableLights;
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Backlight"
+
+#include "Backlight.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+static constexpr uint32_t kDefaultMaxBrightness = 255;
+// one frame at 60 Hz
+static constexpr std::chrono::microseconds kFramePeriod(16667);
+
+static uint32_t readMaxBrightness(const std::string& backlightDir) {
+    std::string path = backlightDir + "/max_brightness";
+    char buf[16];
+    ssize_t len;
+    uint32_t max;
+    int fd;
+
+    fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("open %s failed, errno = %d", path.c_str(), errno);
+        return kDefaultMaxBrightness;
+    }
+
+    len = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+    close(fd);
+    if (len <= 0)
+        return kDefaultMaxBrightness;
+
+    buf[len] = '\0';
+    max = strtoul(buf, NULL, 10);
+    return max > 0 ? max : kDefaultMaxBrightness;
+}
+
+Backlight::Backlight(const std::string& backlightDir)
+    : mBacklightDir(backlightDir), mLevel(-1), mPending(false), mExit(false), mBrightness(0) {
+    std::string path = backlightDir + "/brightness";
+
+    mMaxBrightness = readMaxBrightness(backlightDir);
+    mFd = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+    if (mFd < 0) {
+        ALOGE("open %s failed, errno = %d", path.c_str(), errno);
+        return;
+    }
+
+    mThread = std::thread(&Backlight::run, this);
+}
+
+Backlight::~Backlight() {
+    if (mThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mExit = true;
+        }
+        mCond.notify_one();
+        mThread.join();
+    }
+
+    if (mFd >= 0)
+        close(mFd);
+}
+
+void Backlight::setBrightness(uint32_t brightness) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBrightness = brightness;
+        mPending = true;
+    }
+    mCond.notify_one();
+}
+
+int Backlight::write(uint32_t level) {
+    char buf[16];
+    int len;
+
+    if (mLevel == level)
+        return 0;
+
+    len = snprintf(buf, sizeof(buf), "%u\n", level);
+    if (TEMP_FAILURE_RETRY(pwrite(mFd, buf, len, 0)) != len) {
+        ALOGE("write %s/brightness failed, errno = %d", mBacklightDir.c_str(), errno);
+        mLevel = -1;
+        return -errno;
+    }
+
+    mLevel = level;
+    return 0;
+}
+
+void Backlight::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    std::chrono::steady_clock::time_point nextFrame;
+    uint32_t level;
+
+    for (;;) {
+        mCond.wait(lock, [this] { return mPending || mExit; });
+        if (mExit)
+            return;
+
+        // let the rest of this frame's updates come in, only the last counts
+        if (std::chrono::steady_clock::now() < nextFrame) {
+            mCond.wait_until(lock, nextFrame, [this] { return mExit; });
+            if (mExit)
+                return;
+        }
+
+        mPending = false;
+        level = (mBrightness * mMaxBrightness + 127) / 255;
+        lock.unlock();
+
+        write(level);
+        nextFrame = std::chrono::steady_clock::now() + kFramePeriod;
+
+        lock.lock();
+    }
+}
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
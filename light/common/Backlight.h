@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+/*
+ * Panel backlight driven through the backlight class device. Brightness
+ * animations set a new level on every animation step, so the writes are
+ * done from a thread that applies the latest level at most once per display
+ * frame and drops the levels in between.
+ */
+class Backlight {
+  public:
+    Backlight(const std::string& backlightDir);
+    ~Backlight();
+
+    // brightness in 0 - 255, scaled to the range of the panel
+    void setBrightness(uint32_t brightness);
+
+  private:
+    void run();
+    int write(uint32_t level);
+
+    std::string mBacklightDir;
+    int mFd;
+    uint32_t mMaxBrightness;
+    int64_t mLevel;
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mPending;
+    bool mExit;
+    uint32_t mBrightness;
+    std::thread mThread;
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
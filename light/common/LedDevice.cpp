@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LedDevice"
+
+#include "LedDevice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+static const char* const kAttrNames[] = {
+    "blink",
+    "brightness",
+    "duty_pcts",
+    "ramp_step_ms",
+    "pause_hi",
+    "pause_lo",
+    "start_idx",
+};
+
+LedDevice::LedDevice(const std::string& ledDir) : mLedDir(ledDir) {
+    for (int i = 0; i < ATTR_COUNT; i++)
+        mFds[i] = -1;
+}
+
+LedDevice::~LedDevice() {
+    for (int i = 0; i < ATTR_COUNT; i++) {
+        if (mFds[i] >= 0)
+            close(mFds[i]);
+    }
+}
+
+int LedDevice::openAttr(Attr attr) {
+    std::string path = mLedDir + "/" + kAttrNames[attr];
+
+    if (mFds[attr] >= 0)
+        return 0;
+
+    mFds[attr] = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+    if (mFds[attr] < 0) {
+        ALOGE("open %s failed, errno = %d", path.c_str(), errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+int LedDevice::write(Attr attr, const std::string& value) {
+    ssize_t len = value.size();
+    int ret;
+
+    if (mValues[attr] == value)
+        return 0;
+
+    ret = openAttr(attr);
+    if (ret != 0)
+        return ret;
+
+    if (TEMP_FAILURE_RETRY(pwrite(mFds[attr], value.c_str(), len, 0)) != len) {
+        ret = -errno;
+        ALOGE("write %s/%s failed, errno = %d", mLedDir.c_str(), kAttrNames[attr], errno);
+        // the driver state is unknown now, write it again next time
+        mValues[attr].clear();
+        return ret;
+    }
+
+    mValues[attr] = value;
+    return 0;
+}
+
+int LedDevice::write(Attr attr, uint32_t value) {
+    return write(attr, std::to_string(value));
+}
+
+int LedDevice::writeProgram(const LedProgram& program) {
+    int ret;
+
+    ret = write(START_IDX, program.startIdx);
+    if (ret == 0)
+        ret = write(DUTY_PCTS, program.dutyPcts);
+    if (ret == 0)
+        ret = write(PAUSE_LO, program.pauseLo);
+    if (ret == 0)
+        ret = write(PAUSE_HI, program.pauseHi);
+    if (ret == 0)
+        ret = write(RAMP_STEP_MS, program.rampStepMs);
+
+    return ret;
+}
+
+int LedDevice::setState(const LedState& state) {
+    const std::string on = "1", off = "0";
+    int ret;
+
+    if (state.program != nullptr) {
+        const LedProgram& program = *state.program;
+
+        if (mValues[BLINK] == on && mValues[START_IDX] == std::to_string(program.startIdx) &&
+                mValues[DUTY_PCTS] == program.dutyPcts &&
+                mValues[PAUSE_LO] == std::to_string(program.pauseLo) &&
+                mValues[PAUSE_HI] == std::to_string(program.pauseHi) &&
+                mValues[RAMP_STEP_MS] == std::to_string(program.rampStepMs))
+            return 0;
+
+        // the LUT is only reloaded when the pattern is started
+        ret = write(BLINK, off);
+        if (ret == 0)
+            ret = writeProgram(program);
+        if (ret == 0)
+            ret = write(BLINK, on);
+        mValues[BRIGHTNESS].clear();
+        return ret;
+    }
+
+    // stopping the pattern leaves the LED off
+    if (mValues[BLINK] != off) {
+        ret = write(BLINK, off);
+        if (ret != 0)
+            return ret;
+        mValues[BRIGHTNESS].clear();
+    }
+
+    return write(BRIGHTNESS, state.brightness);
+}
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "LedPattern.h"
+
+namespace android {
+namespace hardware {
+namespace light {
+
+struct LedState {
+    uint32_t brightness;
+    // runs the program instead of a steady brightness when set
+    std::shared_ptr<const LedProgram> program;
+};
+
+/*
+ * Backend for a qpnp LPG driven LED class device, shared by the AIDL and
+ * HIDL lights HALs. The attribute fds are kept open and the last value
+ * written to each attribute is remembered, so a state transition only costs
+ * the writes that actually change something and setting the current state
+ * again costs none. Not thread safe, callers serialize access.
+ */
+class LedDevice {
+  public:
+    LedDevice(const std::string& ledDir);
+    ~LedDevice();
+
+    int setState(const LedState& state);
+
+  private:
+    enum Attr {
+        BLINK,
+        BRIGHTNESS,
+        DUTY_PCTS,
+        RAMP_STEP_MS,
+        PAUSE_HI,
+        PAUSE_LO,
+        START_IDX,
+        ATTR_COUNT,
+    };
+
+    int write(Attr attr, const std::string& value);
+    int write(Attr attr, uint32_t value);
+    int writeProgram(const LedProgram& program);
+    int openAttr(Attr attr);
+
+    std::string mLedDir;
+    int mFds[ATTR_COUNT];
+    // last value committed to each attribute, empty when unknown
+    std::string mValues[ATTR_COUNT];
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
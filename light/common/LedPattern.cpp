@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LedPattern.h"
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+// the white LED owns the start of the LUT
+static constexpr uint32_t kLutStart = 0;
+static constexpr uint32_t kBreatheSteps = 15;
+// fades longer than this look sluggish rather than smooth
+static constexpr uint32_t kMaxRampMs = 600;
+static constexpr uint32_t kFlashStepMs = 1;
+static constexpr size_t kMaxCacheSize = 16;
+
+static std::string dutyPcts(uint32_t brightness, uint32_t steps) {
+    uint32_t peak = (brightness * 100 + 254) / 255;
+    std::string output;
+
+    // quadratic curve, so the fade looks linear to the eye
+    for (uint32_t i = 0; i <= steps; i++) {
+        if (i != 0) {
+            output += ",";
+        }
+        output += std::to_string(peak * i * i / (steps * steps));
+    }
+    return output;
+}
+
+static LedProgram compilePattern(const LedPattern& pattern) {
+    LedProgram program;
+    uint32_t steps, rampMs;
+
+    if (pattern.breathe) {
+        rampMs = std::min({pattern.onMs, pattern.offMs, kMaxRampMs});
+        steps = std::max(1u, std::min(kBreatheSteps, rampMs));
+        program.rampStepMs = std::max(1u, rampMs / steps);
+    } else {
+        steps = 1;
+        program.rampStepMs = kFlashStepMs;
+    }
+
+    // the ramps eat into the on and off times
+    rampMs = steps * program.rampStepMs;
+    program.dutyPcts = dutyPcts(pattern.brightness, steps);
+    program.pauseHi = pattern.onMs > rampMs ? pattern.onMs - rampMs : 0;
+    program.pauseLo = pattern.offMs > rampMs ? pattern.offMs - rampMs : 0;
+    program.startIdx = kLutStart;
+    return program;
+}
+
+std::shared_ptr<const LedProgram> LedPatternCompiler::compile(const LedPattern& pattern) {
+    Key key(pattern.brightness, pattern.onMs, pattern.offMs, pattern.breathe);
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mCache.find(key);
+    if (it != mCache.end())
+        return it->second;
+
+    if (mCache.size() >= kMaxCacheSize)
+        mCache.clear();
+
+    auto program = std::make_shared<const LedProgram>(compilePattern(pattern));
+    mCache.emplace(key, program);
+    return program;
+}
+
+uint32_t colorToBrightness(uint32_t color, uint32_t maxBrightness) {
+    uint32_t alpha = (color >> 24) & 0xff;
+    uint32_t red = (color >> 16) & 0xff;
+    uint32_t green = (color >> 8) & 0xff;
+    uint32_t blue = color & 0xff;
+    // the white LED stands in for any hue, so only the intensity counts
+    uint32_t brightness = std::max({red, green, blue});
+
+    // a zero alpha is treated as opaque
+    if (alpha != 0)
+        brightness = brightness * alpha / 0xff;
+
+    // any color that is lit keeps the LED on
+    brightness = brightness * maxBrightness / 0xff;
+    if (brightness == 0 && (color & 0xffffff))
+        brightness = 1;
+
+    return brightness;
+}
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
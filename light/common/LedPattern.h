@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+/*
+ * A program for the LPG lookup table. Once blink is set, the PMIC ramps
+ * through duty_pcts one entry every rampStepMs, holds the last entry for
+ * pauseHi, ramps back down and holds the first entry for pauseLo, without
+ * any help from the CPU.
+ */
+struct LedProgram {
+    std::string dutyPcts;
+    uint32_t rampStepMs;
+    uint32_t pauseHi;
+    uint32_t pauseLo;
+    uint32_t startIdx;
+};
+
+struct LedPattern {
+    // peak brightness, 0 - 255
+    uint32_t brightness;
+    uint32_t onMs;
+    uint32_t offMs;
+    // fade in and out instead of a square flash
+    bool breathe;
+};
+
+/*
+ * Compiles flash patterns into LPG programs. Programs are cached by pattern,
+ * as the same handful of notification patterns is set over and over again.
+ */
+class LedPatternCompiler {
+  public:
+    std::shared_ptr<const LedProgram> compile(const LedPattern& pattern);
+
+  private:
+    typedef std::tuple<uint32_t, uint32_t, uint32_t, bool> Key;
+
+    std::mutex mLock;
+    std::map<Key, std::shared_ptr<const LedProgram>> mCache;
+};
+
+// scales an ARGB color to the brightness of a white LED, 0 - maxBrightness
+uint32_t colorToBrightness(uint32_t color, uint32_t maxBrightness);
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
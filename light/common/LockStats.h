@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace android {
+namespace hardware {
+namespace light {
+
+// hold times of one HAL lock, summed over every critical section
+struct LockStats {
+    std::atomic<uint64_t> holds{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+};
+
+/*
+ * Adds the time from its construction to its destruction to a LockStats, so
+ * it is declared right after the lock is taken. Only the benchmark defines
+ * LIGHT_LOCK_STATS; the services build it as an empty object.
+ */
+class LockHoldTimer {
+  public:
+#ifdef LIGHT_LOCK_STATS
+    explicit LockHoldTimer(LockStats* stats)
+        : mStats(stats), mStart(std::chrono::steady_clock::now()) {}
+
+    ~LockHoldTimer() {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - mStart).count();
+        uint64_t max = mStats->maxNs.load(std::memory_order_relaxed);
+
+        mStats->holds.fetch_add(1, std::memory_order_relaxed);
+        mStats->totalNs.fetch_add(ns, std::memory_order_relaxed);
+        while (ns > max &&
+               !mStats->maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+            ;
+    }
+
+  private:
+    LockStats* mStats;
+    std::chrono::steady_clock::time_point mStart;
+#else
+    explicit LockHoldTimer(LockStats*) {}
+#endif
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
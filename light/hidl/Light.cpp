@@ -20,8 +20,6 @@
 #include "Light.h"
 
 #include <android-base/logging.h>
-#include <android-base/stringprintf.h>
-#include <fstream>
 
 namespace android {
 namespace hardware {
@@ -29,96 +27,50 @@ namespace light {
 namespace V2_0 {
 namespace implementation {
 
-/*
- * Write value to path and close file.
- */
-template <typename T>
-static void set(const std::string& path, const T& value) {
-    std::ofstream file(path);
-    file << value;
-}
+static constexpr const char* kLedDir = "/sys/class/leds/white";
 
+// brightness of a full white color
 static constexpr uint32_t kBrightnessNoBlink = 5;
+static constexpr size_t kBatteryIndex = 2;
 
-Light::Light() {
-    mLights.emplace(Type::ATTENTION, std::bind(&Light::handleNotification, this, std::placeholders::_1, 0));
-    mLights.emplace(Type::NOTIFICATIONS, std::bind(&Light::handleNotification, this, std::placeholders::_1, 1));
-    mLights.emplace(Type::BATTERY, std::bind(&Light::handleNotification, this, std::placeholders::_1, 2));
+Light::Light() : Light(kLedDir) {
 }
 
-void Light::handleBattery(const LightState& state) {
-    uint32_t whiteBrightness = getBrightness(state);
-
-    uint32_t onMs = state.flashMode == Flash::TIMED ? state.flashOnMs : 0;
-    uint32_t offMs = state.flashMode == Flash::TIMED ? state.flashOffMs : 0;
-
-    auto getScaledDutyPercent = [](int brightness) -> std::string {
-        std::string output;
-        for (int i = 0; i <= kRampSteps; i++) {
-            if (i != 0) {
-                output += ",";
-            }
-            if (i <= kRampSteps / 2) {
-                output += "0";
-            } else {
-                output += std::to_string((i - kRampSteps / 2) * 100 * brightness /
-                                         (kDefaultMaxBrightness * (kRampSteps/2)));
-            }
-        }
-        return output;
-    };
-
-    // Disable blinking to start
-    set("/sys/class/leds/white/blink", 0);
-
-    if (onMs > 0 && offMs > 0) {
-        uint32_t pauseLo, pauseHi, stepDuration;
-        stepDuration = 10;
-        if (stepDuration * kRampSteps > onMs) {
-            pauseHi = 0;
-        } else {
-            pauseHi = onMs - kRampSteps * stepDuration;
-            pauseLo = offMs - kRampSteps * stepDuration;
-        }
-
-        set("/sys/class/leds/white/start_idx", 0);
-        set("/sys/class/leds/white/duty_pcts", getScaledDutyPercent(whiteBrightness));
-        set("/sys/class/leds/white/pause_lo", pauseLo);
-        set("/sys/class/leds/white/pause_hi", pauseHi);
-        set("/sys/class/leds/white/ramp_step_ms", stepDuration);
-
-        // Start blinking
-        set("/sys/class/leds/white/blink", 1);
-    } else {
-        set("/sys/class/leds/white/brightness", whiteBrightness);
-    }
+Light::Light(const std::string& ledDir) : mLed(ledDir) {
+    mLights.emplace(Type::ATTENTION, std::bind(&Light::handleNotification, this, std::placeholders::_1, 0));
+    mLights.emplace(Type::NOTIFICATIONS, std::bind(&Light::handleNotification, this, std::placeholders::_1, 1));
+    mLights.emplace(Type::BATTERY, std::bind(&Light::handleNotification, this, std::placeholders::_1, kBatteryIndex));
 }
 
 void Light::handleNotification(const LightState& state, size_t index) {
     mLightStates.at(index) = state;
 
-    uint32_t whiteBrightness = 0;
+    size_t indexToUse = 0;
     LightState stateToUse = mLightStates.front();
-    for (const auto& lightState : mLightStates) {
-        if (lightState.color & 0xffffff) {
-            stateToUse = lightState;
-            whiteBrightness = kBrightnessNoBlink;
+    for (size_t i = 0; i < mLightStates.size(); i++) {
+        if (mLightStates[i].color & 0xffffff) {
+            stateToUse = mLightStates[i];
+            indexToUse = i;
             break;
         }
     }
 
-    uint32_t onMs = stateToUse.flashMode == Flash::TIMED ? stateToUse.flashOnMs : 0;
-    uint32_t offMs = stateToUse.flashMode == Flash::TIMED ? stateToUse.flashOffMs : 0;
-
-    // Disable blinking to start
-    set("/sys/class/leds/white/blink", 0);
-
-    if (onMs > 0 && offMs > 0) {
-        // Start blinking
-        set("/sys/class/leds/white/blink", 1);
-    } else {
-        set("/sys/class/leds/white/brightness", whiteBrightness);
+    uint32_t onMs = stateToUse.flashMode != Flash::NONE ? stateToUse.flashOnMs : 0;
+    uint32_t offMs = stateToUse.flashMode != Flash::NONE ? stateToUse.flashOffMs : 0;
+    LedState ledState = {};
+
+    ledState.brightness = colorToBrightness(stateToUse.color, kBrightnessNoBlink);
+    if (ledState.brightness > 0 && onMs > 0 && offMs > 0) {
+        // the battery light breathes rather than flashes
+        ledState.program = mCompiler.compile({
+            .brightness = ledState.brightness,
+            .onMs = onMs,
+            .offMs = offMs,
+            .breathe = indexToUse == kBatteryIndex || stateToUse.flashMode == Flash::HARDWARE,
+        });
     }
+
+    mLed.setState(ledState);
 }
 
 Return<Status> Light::setLight(Type type, const LightState& state) {
@@ -130,6 +82,7 @@ Return<Status> Light::setLight(Type type, const LightState& state) {
 
     // Lock global mutex until light state is updated.
     std::lock_guard<std::mutex> lock(mLock);
+    LockHoldTimer timer(&mLockStats);
 
     it->second(state);
 
@@ -24,6 +24,9 @@
 #include <unordered_map>
 #include <mutex>
 
+#include "LedDevice.h"
+#include "LockStats.h"
+
 namespace android {
 namespace hardware {
 namespace light {
@@ -41,17 +44,21 @@ using ::android::hardware::light::V2_0::Type;
 class Light : public ILight {
   public:
     Light();
+    Light(const std::string& ledDir);
 
     Return<Status> setLight(Type type, const LightState& state) override;
     Return<void> getSupportedTypes(getSupportedTypes_cb _hidl_cb) override;
+    const LockStats& lockStats() const { return mLockStats; }
 
   private:
-    void handleBattery(const LightState& state);
     void handleNotification(const LightState& state, size_t index);
 
+    LedDevice mLed;
+    LedPatternCompiler mCompiler;
     std::mutex mLock;
+    LockStats mLockStats;
     std::unordered_map<Type, std::function<void(const LightState&)>> mLights;
-    std::array<LightState, 2> mLightStates;
+    std::array<LightState, 3> mLightStates;
 };
 
 }  // namespace implementation
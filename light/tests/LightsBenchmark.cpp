@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "Light.h"
+#include "Lights.h"
+
+using android::base::ReadFileToString;
+using android::base::TemporaryDir;
+using android::base::WriteStringToFile;
+using android::hardware::light::LockStats;
+
+namespace aidl_light = aidl::android::hardware::light;
+namespace hidl_light = android::hardware::light::V2_0;
+
+namespace {
+
+const char* const kLedAttrs[] = {
+    "blink", "brightness", "duty_pcts", "ramp_step_ms", "pause_hi", "pause_lo", "start_idx",
+};
+
+// lights the threads take turns on, thread i drives the (i % size)th
+const aidl_light::LightType kAidlTypes[] = {
+    aidl_light::LightType::NOTIFICATIONS,
+    aidl_light::LightType::BATTERY,
+    aidl_light::LightType::ATTENTION,
+    aidl_light::LightType::BACKLIGHT,
+};
+
+const hidl_light::Type kHidlTypes[] = {
+    hidl_light::Type::NOTIFICATIONS,
+    hidl_light::Type::BATTERY,
+    hidl_light::Type::ATTENTION,
+};
+
+// temporary LED and backlight class devices, with every attribute the HALs write
+struct FakeSysfs {
+    FakeSysfs() {
+        for (const char* attr : kLedAttrs)
+            WriteStringToFile("", std::string(led.path) + "/" + attr);
+        WriteStringToFile("2047\n", std::string(backlight.path) + "/max_brightness");
+        WriteStringToFile("", std::string(backlight.path) + "/brightness");
+    }
+
+    TemporaryDir led;
+    TemporaryDir backlight;
+};
+
+// read and write syscalls made by the whole process so far, from /proc/self/io
+uint64_t rwSyscalls() {
+    std::string content;
+    uint64_t syscr = 0, syscw = 0;
+
+    if (!ReadFileToString("/proc/self/io", &content))
+        return 0;
+
+    for (const char* line = content.c_str(); line != NULL; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+        sscanf(line, "syscr: %" SCNu64, &syscr);
+        sscanf(line, "syscw: %" SCNu64, &syscw);
+    }
+
+    return syscr + syscw;
+}
+
+// every few calls blink, and every so often go dark, so all the LED paths are taken
+uint32_t benchColor(int64_t i) {
+    return i % 16 == 15 ? 0 : 0xff000000 | ((i * 0x010203) & 0xffffff);
+}
+
+void reportCounters(benchmark::State& state, uint64_t syscalls, const LockStats& stats) {
+    double calls = (double)state.iterations() * state.threads();
+    uint64_t holds = stats.holds.load();
+
+    state.counters["syscalls_per_call"] = syscalls / calls;
+    state.counters["lock_hold_avg_ns"] = holds ? (double)stats.totalNs.load() / holds : 0;
+    state.counters["lock_hold_max_ns"] = stats.maxNs.load();
+}
+
+/*
+ * The first thread sets the HAL up before the timed loop and tears it down
+ * after it; google-benchmark starts and stops the threads' loops together.
+ * Syscalls are counted over the HAL's whole life, so the writes it defers
+ * to its own threads are included.
+ */
+std::unique_ptr<FakeSysfs> gSysfs;
+std::shared_ptr<aidl_light::Lights> gLights;
+android::sp<hidl_light::implementation::Light> gLight;
+uint64_t gSyscalls;
+
+void BM_AidlSetLightState(benchmark::State& state) {
+    aidl_light::LightType type = kAidlTypes[state.thread_index() % std::size(kAidlTypes)];
+    aidl_light::HwLightState light;
+    int64_t i = 0;
+
+    if (state.thread_index() == 0) {
+        gSysfs = std::make_unique<FakeSysfs>();
+        gSyscalls = rwSyscalls();
+        gLights = ndk::SharedRefBase::make<aidl_light::Lights>(gSysfs->led.path,
+                                                               gSysfs->backlight.path);
+    }
+
+    for (auto _ : state) {
+        light.color = benchColor(i);
+        light.flashMode = i % 4 ? aidl_light::FlashMode::NONE : aidl_light::FlashMode::TIMED;
+        light.flashOnMs = 500;
+        light.flashOffMs = 1500;
+        if (!gLights->setLightState((int)type, light).isOk())
+            state.SkipWithError("setLightState failed");
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        LockStats stats;
+
+        stats.holds = gLights->lockStats().holds.load();
+        stats.totalNs = gLights->lockStats().totalNs.load();
+        stats.maxNs = gLights->lockStats().maxNs.load();
+        gLights.reset();
+        reportCounters(state, rwSyscalls() - gSyscalls, stats);
+        gSysfs.reset();
+    }
+}
+BENCHMARK(BM_AidlSetLightState)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_HidlSetLight(benchmark::State& state) {
+    hidl_light::Type type = kHidlTypes[state.thread_index() % std::size(kHidlTypes)];
+    hidl_light::LightState light;
+    int64_t i = 0;
+
+    if (state.thread_index() == 0) {
+        gSysfs = std::make_unique<FakeSysfs>();
+        gSyscalls = rwSyscalls();
+        gLight = new hidl_light::implementation::Light(gSysfs->led.path);
+    }
+
+    for (auto _ : state) {
+        light.color = benchColor(i);
+        light.flashMode = i % 4 ? hidl_light::Flash::NONE : hidl_light::Flash::TIMED;
+        light.flashOnMs = 500;
+        light.flashOffMs = 1500;
+        if (gLight->setLight(type, light) != hidl_light::Status::SUCCESS)
+            state.SkipWithError("setLight failed");
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        reportCounters(state, rwSyscalls() - gSyscalls, gLight->lockStats());
+        gLight = nullptr;
+        gSysfs.reset();
+    }
+}
+BENCHMARK(BM_HidlSetLight)->ThreadRange(1, 8)->UseRealTime();
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+#ifndef __ANDROID__
+    // host liblog prints every setLightState() to stderr
+    __android_log_set_minimum_priority(ANDROID_LOG_WARN);
+#endif
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
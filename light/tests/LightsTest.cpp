@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Backlight.h"
+#include "LedDevice.h"
+#include "LedPattern.h"
+#include "Light.h"
+#include "Lights.h"
+
+using android::base::ReadFileToString;
+using android::base::TemporaryDir;
+using android::base::WriteStringToFile;
+using android::hardware::light::Backlight;
+using android::hardware::light::colorToBrightness;
+using android::hardware::light::LedDevice;
+using android::hardware::light::LedPatternCompiler;
+using android::hardware::light::LedProgram;
+using android::hardware::light::LedState;
+
+namespace aidl_light = aidl::android::hardware::light;
+namespace hidl_light = android::hardware::light::V2_0;
+
+namespace {
+
+const char* const kLedAttrs[] = {
+    "blink", "brightness", "duty_pcts", "ramp_step_ms", "pause_hi", "pause_lo", "start_idx",
+};
+
+/*
+ * Temporary directory standing in for a sysfs class device. The attributes
+ * are plain files, so they are cleared before each step to see exactly what
+ * the step wrote; a cleared file that stays empty was not written at all.
+ */
+class FakeSysfs {
+  public:
+    std::string dir() const { return mDir.path; }
+    std::string path(const std::string& attr) const { return dir() + "/" + attr; }
+
+    void set(const std::string& attr, const std::string& value) {
+        ASSERT_TRUE(WriteStringToFile(value, path(attr)));
+    }
+
+    std::string get(const std::string& attr) const {
+        std::string value;
+
+        EXPECT_TRUE(ReadFileToString(path(attr), &value));
+        return value;
+    }
+
+    void clear() {
+        for (const char* attr : kLedAttrs)
+            set(attr, "");
+    }
+
+    // whether any attribute was written since the last clear()
+    bool written() const {
+        for (const char* attr : kLedAttrs) {
+            if (!get(attr).empty())
+                return true;
+        }
+        return false;
+    }
+
+  private:
+    TemporaryDir mDir;
+};
+
+LedState steady(uint32_t brightness) {
+    return LedState{brightness, nullptr};
+}
+
+// calls per thread before the final state is set
+constexpr int kRacingCalls = 500;
+
+// colors the racing threads go through, including black
+uint32_t racingColor(int i) {
+    return 0xff000000 | ((i * 0x010203) & 0xffffff);
+}
+
+// run each function on its own thread, all at once
+void race(const std::vector<std::function<void()>>& fns) {
+    std::vector<std::thread> threads;
+
+    for (const auto& fn : fns)
+        threads.emplace_back(fn);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+// wait for the asynchronous writers to settle on the expected attribute value
+bool waitFor(const FakeSysfs& sysfs, const std::string& attr, const std::string& value) {
+    for (int i = 0; i < 100; i++) {
+        if (sysfs.get(attr) == value)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+}  // anonymous namespace
+
+TEST(LedDeviceTest, WritesSteadyBrightness) {
+    FakeSysfs sysfs;
+    sysfs.clear();
+    LedDevice led(sysfs.dir());
+
+    EXPECT_EQ(led.setState(steady(128)), 0);
+    EXPECT_EQ(sysfs.get("blink"), "0");
+    EXPECT_EQ(sysfs.get("brightness"), "128");
+    EXPECT_EQ(sysfs.get("duty_pcts"), "");
+}
+
+TEST(LedDeviceTest, SkipsUnchangedState) {
+    FakeSysfs sysfs;
+    sysfs.clear();
+    LedDevice led(sysfs.dir());
+    LedPatternCompiler compiler;
+    LedState blink = {255, compiler.compile({255, 1000, 1000, true})};
+
+    ASSERT_EQ(led.setState(steady(128)), 0);
+    sysfs.clear();
+    EXPECT_EQ(led.setState(steady(128)), 0);
+    EXPECT_FALSE(sysfs.written());
+
+    ASSERT_EQ(led.setState(blink), 0);
+    sysfs.clear();
+    EXPECT_EQ(led.setState(blink), 0);
+    EXPECT_FALSE(sysfs.written());
+}
+
+TEST(LedDeviceTest, StartsProgramAfterLoadingIt) {
+    FakeSysfs sysfs;
+    sysfs.clear();
+    LedDevice led(sysfs.dir());
+    LedPatternCompiler compiler;
+    std::shared_ptr<const LedProgram> program = compiler.compile({255, 500, 1500, false});
+
+    ASSERT_EQ(led.setState(steady(64)), 0);
+    sysfs.clear();
+    EXPECT_EQ(led.setState({255, program}), 0);
+    EXPECT_EQ(sysfs.get("blink"), "1");
+    EXPECT_EQ(sysfs.get("duty_pcts"), program->dutyPcts);
+    EXPECT_EQ(sysfs.get("ramp_step_ms"), std::to_string(program->rampStepMs));
+    EXPECT_EQ(sysfs.get("pause_hi"), std::to_string(program->pauseHi));
+    EXPECT_EQ(sysfs.get("pause_lo"), std::to_string(program->pauseLo));
+    EXPECT_EQ(sysfs.get("start_idx"), std::to_string(program->startIdx));
+    // the brightness is left to the program
+    EXPECT_EQ(sysfs.get("brightness"), "");
+
+    // stopping the program stops blinking before the steady level is set
+    sysfs.clear();
+    EXPECT_EQ(led.setState(steady(64)), 0);
+    EXPECT_EQ(sysfs.get("blink"), "0");
+    EXPECT_EQ(sysfs.get("brightness"), "64");
+}
+
+TEST(LedDeviceTest, FailsWithoutAttributes) {
+    TemporaryDir dir;
+    LedDevice led(dir.path);
+
+    EXPECT_LT(led.setState(steady(128)), 0);
+}
+
+TEST(LedPatternCompilerTest, CachesPrograms) {
+    LedPatternCompiler compiler;
+
+    EXPECT_EQ(compiler.compile({255, 1000, 1000, true}), compiler.compile({255, 1000, 1000, true}));
+    EXPECT_NE(compiler.compile({255, 1000, 1000, true}), compiler.compile({255, 1000, 1000, false}));
+}
+
+TEST(LedPatternCompilerTest, CompilesFlash) {
+    LedPatternCompiler compiler;
+    std::shared_ptr<const LedProgram> program = compiler.compile({255, 500, 1500, false});
+
+    EXPECT_EQ(program->dutyPcts, "0,100");
+    EXPECT_EQ(program->rampStepMs, 1u);
+    EXPECT_EQ(program->pauseHi, 499u);
+    EXPECT_EQ(program->pauseLo, 1499u);
+}
+
+TEST(LedPatternCompilerTest, CompilesBreathe) {
+    LedPatternCompiler compiler;
+    std::shared_ptr<const LedProgram> program = compiler.compile({255, 1000, 2000, true});
+
+    // 15 steps of 40 ms, capped at a 600 ms ramp
+    EXPECT_EQ(program->dutyPcts.substr(0, 2), "0,");
+    EXPECT_EQ(program->dutyPcts.substr(program->dutyPcts.size() - 4), ",100");
+    EXPECT_EQ(program->rampStepMs, 40u);
+    EXPECT_EQ(program->pauseHi, 400u);
+    EXPECT_EQ(program->pauseLo, 1400u);
+}
+
+TEST(LedPatternCompilerTest, CompilesShortBreathe) {
+    LedPatternCompiler compiler;
+    std::shared_ptr<const LedProgram> program = compiler.compile({255, 5, 5, true});
+
+    EXPECT_EQ(program->rampStepMs, 1u);
+    EXPECT_EQ(program->pauseHi, 0u);
+    EXPECT_EQ(program->pauseLo, 0u);
+}
+
+TEST(ColorToBrightnessTest, ScalesColors) {
+    EXPECT_EQ(colorToBrightness(0xffffffff, 255), 255u);
+    EXPECT_EQ(colorToBrightness(0x00ffffff, 255), 255u);
+    EXPECT_EQ(colorToBrightness(0x80ff0000, 255), 128u);
+    EXPECT_EQ(colorToBrightness(0xff000000, 255), 0u);
+    EXPECT_EQ(colorToBrightness(0xff000001, 255), 1u);
+    EXPECT_EQ(colorToBrightness(0xff00ff00, 4095), 4095u);
+}
+
+TEST(BacklightTest, ScalesToPanelRange) {
+    FakeSysfs sysfs;
+    sysfs.set("max_brightness", "2047\n");
+    sysfs.set("brightness", "");
+    Backlight backlight(sysfs.dir());
+    std::string value;
+
+    backlight.setBrightness(255);
+    for (int i = 0; i < 100 && value.empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        value = sysfs.get("brightness");
+    }
+    EXPECT_EQ(value, "2047\n");
+}
+
+TEST(BacklightTest, AppliesLatestLevel) {
+    FakeSysfs sysfs;
+    sysfs.set("max_brightness", "255\n");
+    sysfs.set("brightness", "");
+    Backlight backlight(sysfs.dir());
+    std::string value;
+
+    for (uint32_t level = 1; level <= 200; level++)
+        backlight.setBrightness(level);
+
+    for (int i = 0; i < 100 && value != "200\n"; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        value = sysfs.get("brightness");
+    }
+    EXPECT_EQ(value, "200\n");
+}
+
+// attention is off at the end, so the notification outranks the battery light
+TEST(LightsArbitrationTest, AidlSettlesOnHighestPriority) {
+    FakeSysfs led, backlight;
+    led.clear();
+    backlight.set("max_brightness", "255\n");
+    backlight.set("brightness", "");
+    auto lights = ndk::SharedRefBase::make<aidl_light::Lights>(led.dir(), backlight.dir());
+
+    auto hammer = [&lights](aidl_light::LightType type, const aidl_light::HwLightState& last) {
+        return [&lights, type, last] {
+            aidl_light::HwLightState state;
+
+            for (int i = 0; i < kRacingCalls; i++) {
+                state.color = racingColor(i);
+                state.flashMode = i % 3 ? aidl_light::FlashMode::NONE
+                                        : aidl_light::FlashMode::TIMED;
+                state.flashOnMs = 500;
+                state.flashOffMs = 1500;
+                EXPECT_TRUE(lights->setLightState((int)type, state).isOk());
+            }
+            EXPECT_TRUE(lights->setLightState((int)type, last).isOk());
+        };
+    };
+    aidl_light::HwLightState off, notification, battery, panel;
+    notification.color = 0xffffffff;
+    battery.color = 0xff00ff00;
+    battery.flashMode = aidl_light::FlashMode::TIMED;
+    battery.flashOnMs = 1000;
+    battery.flashOffMs = 1000;
+    panel.color = 0xff808080;
+
+    race({
+        hammer(aidl_light::LightType::ATTENTION, off),
+        hammer(aidl_light::LightType::NOTIFICATIONS, notification),
+        hammer(aidl_light::LightType::BATTERY, battery),
+        hammer(aidl_light::LightType::BACKLIGHT, panel),
+    });
+
+    EXPECT_TRUE(waitFor(led, "brightness", "90"));
+    EXPECT_TRUE(waitFor(led, "blink", "0"));
+    EXPECT_TRUE(waitFor(backlight, "brightness", "128\n"));
+
+    // nothing older lands after the final state
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(led.get("brightness"), "90");
+    EXPECT_EQ(led.get("blink"), "0");
+}
+
+// the HIDL HAL writes synchronously, so the final state is there on return
+TEST(LightsArbitrationTest, HidlSettlesOnHighestPriority) {
+    FakeSysfs led;
+    led.clear();
+    android::sp<hidl_light::implementation::Light> light =
+            new hidl_light::implementation::Light(led.dir());
+    LedPatternCompiler compiler;
+
+    auto hammer = [&light](hidl_light::Type type, const hidl_light::LightState& last) {
+        return [&light, type, last] {
+            hidl_light::LightState state;
+
+            for (int i = 0; i < kRacingCalls; i++) {
+                state.color = racingColor(i);
+                state.flashMode = i % 3 ? hidl_light::Flash::NONE : hidl_light::Flash::TIMED;
+                state.flashOnMs = 500;
+                state.flashOffMs = 1500;
+                EXPECT_EQ(light->setLight(type, state), hidl_light::Status::SUCCESS);
+            }
+            EXPECT_EQ(light->setLight(type, last), hidl_light::Status::SUCCESS);
+        };
+    };
+    hidl_light::LightState attention, notification, battery;
+    attention.color = 0xffffffff;
+    attention.flashMode = hidl_light::Flash::TIMED;
+    attention.flashOnMs = 500;
+    attention.flashOffMs = 1500;
+    notification.color = 0xffffffff;
+    battery.color = 0xff00ff00;
+
+    race({
+        hammer(hidl_light::Type::ATTENTION, attention),
+        hammer(hidl_light::Type::NOTIFICATIONS, notification),
+        hammer(hidl_light::Type::BATTERY, battery),
+    });
+
+    EXPECT_EQ(led.get("blink"), "1");
+    EXPECT_EQ(led.get("duty_pcts"), compiler.compile({5, 500, 1500, false})->dutyPcts);
+    EXPECT_EQ(led.get("pause_hi"), "499");
+    EXPECT_EQ(led.get("pause_lo"), "1499");
+}
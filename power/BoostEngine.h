@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+enum BoostNode {
+    BOOST_LITTLE_MIN_FREQ,
+    BOOST_BIG_MIN_FREQ,
+    BOOST_TOP_APP_SCHEDTUNE,
+    BOOST_NODE_COUNT,
+};
+
+enum BoostSource {
+    BOOST_SOURCE_LAUNCH,
+    BOOST_SOURCE_COUNT,
+};
+
+// value requested for each node, 0 leaves the node alone
+typedef uint32_t BoostLevel[BOOST_NODE_COUNT];
+
+/*
+ * Temporarily raises the cluster min frequencies and the top-app schedtune
+ * boost above the static tuning from init.qcom.power.rc. Every source holds
+ * at most one request; requesting again merges into it, keeping the higher
+ * level and the later deadline. Each node gets the highest level of all
+ * active requests, and once none is left it goes back to its static value.
+ * A single thread expires the requests.
+ *
+ * The static values are those init.qcom.power.rc writes rather than ones
+ * read back from the nodes: perfd boosts the same nodes, so a value read at
+ * the first boost could be a perfd boost that would then never be undone.
+ * A release still cuts short a perfd boost that overlaps it.
+ */
+class BoostEngine {
+  public:
+    static BoostEngine& getInstance() {
+        static BoostEngine instance;
+        return instance;
+    }
+
+    void request(BoostSource source, const BoostLevel& level, int32_t durationMs) {
+        std::lock_guard<std::mutex> lock(mLock);
+        Request& req = mRequests[source];
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(durationMs);
+
+        if (!req.active) {
+            std::fill(req.level, req.level + BOOST_NODE_COUNT, 0);
+            req.deadline = deadline;
+            req.active = true;
+        }
+        for (int i = 0; i < BOOST_NODE_COUNT; i++)
+            req.level[i] = std::max(req.level[i], level[i]);
+        req.deadline = std::max(req.deadline, deadline);
+
+        update();
+        mCond.notify_one();
+    }
+
+    void release(BoostSource source) {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        mRequests[source].active = false;
+        update();
+    }
+
+  private:
+    struct Request {
+        bool active;
+        BoostLevel level;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    struct Node {
+        const char* path;
+        // written by init.qcom.power.rc, keep in sync
+        uint32_t baseline;
+        int fd;
+        // level last written, 0 while the node is at its baseline
+        uint32_t applied;
+    };
+
+    BoostEngine()
+        : mRequests(),
+          mNodes{
+                  {"/sys/devices/system/cpu/cpu0/cpufreq/scaling_min_freq", 576000, -1, 0},
+                  {"/sys/devices/system/cpu/cpu4/cpufreq/scaling_min_freq", 825000, -1, 0},
+                  {"/dev/stune/top-app/schedtune.boost", 10, -1, 0},
+          } {
+        std::thread(&BoostEngine::run, this).detach();
+    }
+
+    static bool openNode(Node& node) {
+        if (node.fd >= 0)
+            return true;
+
+        node.fd = TEMP_FAILURE_RETRY(open(node.path, O_RDWR | O_CLOEXEC));
+        if (node.fd < 0) {
+            PLOG(ERROR) << "open " << node.path << " failed";
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool writeNode(Node& node, uint32_t level) {
+        std::string value = std::to_string(level);
+
+        if (!openNode(node))
+            return false;
+
+        if (TEMP_FAILURE_RETRY(pwrite(node.fd, value.c_str(), value.size(), 0)) !=
+                static_cast<ssize_t>(value.size())) {
+            PLOG(ERROR) << "write " << value << " to " << node.path << " failed";
+            return false;
+        }
+
+        return true;
+    }
+
+    /*
+     * Called with mLock held, only writes the nodes whose level changed. A
+     * failed write is retried on the next update.
+     */
+    void update() {
+        for (int i = 0; i < BOOST_NODE_COUNT; i++) {
+            Node& node = mNodes[i];
+            uint32_t level = 0;
+
+            for (const Request& req : mRequests) {
+                if (req.active)
+                    level = std::max(level, req.level[i]);
+            }
+
+            if (level == node.applied)
+                continue;
+
+            // a boost never goes below the static tuning, level 0 restores it
+            if (writeNode(node, std::max(level, node.baseline)))
+                node.applied = level;
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mLock);
+
+        for (;;) {
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            bool expired = false;
+
+            for (Request& req : mRequests) {
+                if (!req.active)
+                    continue;
+                if (req.deadline <= now) {
+                    req.active = false;
+                    expired = true;
+                } else {
+                    next = std::min(next, req.deadline);
+                }
+            }
+
+            if (expired)
+                update();
+
+            if (next == std::chrono::steady_clock::time_point::max())
+                mCond.wait(lock);
+            else
+                mCond.wait_until(lock, next);
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    Request mRequests[BOOST_SOURCE_COUNT];
+    Node mNodes[BOOST_NODE_COUNT];
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
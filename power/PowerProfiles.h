@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+// in order of priority, the highest active one is applied
+enum ProfileMode {
+    PROFILE_LOW_POWER,
+    PROFILE_CAMERA_SECURE,
+    PROFILE_CAMERA_LOW,
+    PROFILE_CAMERA_MID,
+    PROFILE_CAMERA_HIGH,
+    PROFILE_LAUNCH,
+    PROFILE_MODE_COUNT,
+};
+
+/*
+ * Named sets of node/value pairs loaded from power_profiles.conf, applied on
+ * top of the static tuning from init.qcom.power.rc. Switching profiles only
+ * writes the nodes whose value changes; a node the new profile doesn't set
+ * gets back its value from the balanced profile, which mirrors the static
+ * tuning. Nodes are never read back, as perfd may have boosted them.
+ */
+class PowerProfiles {
+  public:
+    static PowerProfiles& getInstance() {
+        static PowerProfiles instance;
+        return instance;
+    }
+
+    // returns the name of the profile now in effect
+    std::string setMode(ProfileMode mode, bool enabled) {
+        std::lock_guard<std::mutex> lock(mLock);
+        const char* name = kBalanced;
+
+        mModes[mode] = enabled;
+        for (int i = PROFILE_MODE_COUNT - 1; i >= 0; i--) {
+            if (mModes[i]) {
+                name = kProfileNames[i];
+                break;
+            }
+        }
+
+        apply(name);
+        return mActive;
+    }
+
+  private:
+    static constexpr const char* kProfilesFile = "/vendor/etc/power_profiles.conf";
+    // in effect while no mode is, and what the other profiles fall back to
+    static constexpr const char* kBalanced = "balanced";
+    static constexpr const char* kProfileNames[PROFILE_MODE_COUNT] = {
+        "low_power",
+        "camera_secure",
+        "camera_low",
+        "camera_mid",
+        "camera_high",
+        "launch",
+    };
+
+    struct Setting {
+        std::string path;
+        std::string value;
+    };
+    typedef std::vector<Setting> Profile;
+
+    PowerProfiles() : mModes(), mActive(kBalanced) { load(kProfilesFile); }
+
+    void load(const char* file) {
+        std::string content;
+        Profile* profile = nullptr;
+
+        if (!::android::base::ReadFileToString(file, &content)) {
+            PLOG(ERROR) << "read " << file << " failed";
+            return;
+        }
+
+        for (const std::string& raw : ::android::base::Split(content, "\n")) {
+            std::string line = ::android::base::Trim(raw);
+
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            if (line.front() == '[' && line.back() == ']') {
+                profile = &mProfiles[line.substr(1, line.size() - 2)];
+                continue;
+            }
+
+            size_t split = line.find_first_of(" \t");
+            if (profile == nullptr || split == std::string::npos) {
+                LOG(ERROR) << "invalid line in " << file << ": " << line;
+                continue;
+            }
+
+            profile->push_back(
+                    {line.substr(0, split), ::android::base::Trim(line.substr(split + 1))});
+        }
+    }
+
+    static const Setting* find(const Profile& profile, const std::string& path) {
+        for (const Setting& setting : profile) {
+            if (setting.path == path)
+                return &setting;
+        }
+        return nullptr;
+    }
+
+    const Profile& lookup(const std::string& name) const {
+        static const Profile kEmpty;
+        auto it = mProfiles.find(name);
+
+        return it != mProfiles.end() ? it->second : kEmpty;
+    }
+
+    // called with mLock held
+    void apply(const std::string& name) {
+        const Profile& current = lookup(mActive);
+        const Profile& next = lookup(name);
+        const Profile& balanced = lookup(kBalanced);
+        std::vector<Setting> writes;
+
+        if (name == mActive)
+            return;
+
+        // restore what the new profile doesn't set, in reverse order of applying
+        for (auto setting = current.rbegin(); setting != current.rend(); ++setting) {
+            const Setting* restore = find(balanced, setting->path);
+
+            if (find(next, setting->path) != nullptr)
+                continue;
+
+            if (restore == nullptr) {
+                LOG(ERROR) << "no balanced value for " << setting->path;
+                continue;
+            }
+            if (restore->value != setting->value)
+                writes.push_back(*restore);
+        }
+
+        for (const Setting& setting : next) {
+            const Setting* was = find(current, setting.path);
+
+            if (was == nullptr)
+                was = find(balanced, setting.path);
+            if (was != nullptr && was->value == setting.value)
+                continue;
+
+            writes.push_back(setting);
+        }
+
+        for (const Setting& setting : writes) {
+            if (!::android::base::WriteStringToFile(setting.value, setting.path))
+                PLOG(ERROR) << "write " << setting.value << " to " << setting.path << " failed";
+        }
+
+        LOG(INFO) << "power profile " << name << ", " << writes.size() << " writes";
+        mActive = name;
+    }
+
+    std::mutex mLock;
+    bool mModes[PROFILE_MODE_COUNT];
+    std::map<std::string, Profile> mProfiles;
+    std::string mActive;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
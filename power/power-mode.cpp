@@ -17,31 +17,57 @@
 #include <aidl/android/hardware/power/BnPower.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <linux/input.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "BoostEngine.h"
+#include "PowerProfiles.h"
 
 namespace {
-int open_ts_input() {
+constexpr const char* kInputDir = "/dev/input/";
+
+bool is_ts_input(int fd) {
+    char name[80] = {0};
+
+    if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) <= 0)
+        return false;
+
+    return strcmp(name, "atmel_mxt_ts") == 0 || strcmp(name, "fts_ts") == 0 ||
+            strcmp(name, "fts") == 0 || strcmp(name, "ft5x46") == 0 ||
+            strcmp(name, "synaptics_dsx") == 0 ||
+            strcmp(name, "NVTCapacitiveTouchScreen") == 0;
+}
+
+int open_ts_input(std::string* node) {
     int fd = -1;
-    DIR* dir = opendir("/dev/input");
+    DIR* dir = opendir(kInputDir);
 
     if (dir != NULL) {
         struct dirent* ent;
 
         while ((ent = readdir(dir)) != NULL) {
             if (ent->d_type == DT_CHR) {
-                char absolute_path[PATH_MAX] = {0};
-                char name[80] = {0};
-
-                strcpy(absolute_path, "/dev/input/");
-                strcat(absolute_path, ent->d_name);
-
-                fd = open(absolute_path, O_RDWR);
-                if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) > 0) {
-                    if (strcmp(name, "atmel_mxt_ts") == 0 || strcmp(name, "fts_ts") == 0 ||
-                            strcmp(name, "fts") == 0 || strcmp(name, "ft5x46") == 0 ||
-                            strcmp(name, "synaptics_dsx") == 0 ||
-                            strcmp(name, "NVTCapacitiveTouchScreen") == 0)
-                        break;
+                std::string absolute_path = std::string(kInputDir) + ent->d_name;
+
+                fd = TEMP_FAILURE_RETRY(open(absolute_path.c_str(), O_RDWR | O_CLOEXEC));
+                if (fd < 0)
+                    continue;
+
+                if (is_ts_input(fd)) {
+                    *node = ent->d_name;
+                    break;
                 }
 
                 close(fd);
@@ -54,6 +80,208 @@ int open_ts_input() {
 
     return fd;
 }
+
+/*
+ * DT2W is toggled on every screen on/off transition, so the touchscreen is
+ * only looked up once and its fd is kept. /dev/input is watched for the
+ * touchscreen going away or coming back, e.g. when its driver reloads, and
+ * the last requested wakeup mode is restored on the new node.
+ */
+class TouchscreenInput {
+  public:
+    static TouchscreenInput& getInstance() {
+        static TouchscreenInput instance;
+        return instance;
+    }
+
+    bool setWakeupMode(int mode) {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        mMode = mode;
+        if (mFd < 0)
+            mFd = open_ts_input(&mNode);
+        if (mFd < 0)
+            return false;
+
+        if (mWrittenMode == mode)
+            return true;
+
+        return writeMode();
+    }
+
+  private:
+    TouchscreenInput() : mFd(-1), mMode(-1), mWrittenMode(-1) {
+        mInotifyFd = inotify_init1(IN_CLOEXEC);
+        if (mInotifyFd < 0) {
+            PLOG(ERROR) << "inotify_init1 failed";
+            return;
+        }
+
+        if (inotify_add_watch(mInotifyFd, kInputDir, IN_CREATE | IN_DELETE) < 0) {
+            PLOG(ERROR) << "inotify_add_watch " << kInputDir << " failed";
+            close(mInotifyFd);
+            mInotifyFd = -1;
+            return;
+        }
+
+        std::thread(&TouchscreenInput::watch, this).detach();
+    }
+
+    // called with mLock held
+    bool writeMode() {
+        struct input_event ev = {};
+
+        ev.type = EV_SYN;
+        ev.code = SYN_CONFIG;
+        ev.value = mMode;
+        if (TEMP_FAILURE_RETRY(write(mFd, &ev, sizeof(ev))) != sizeof(ev)) {
+            PLOG(ERROR) << "write wakeup mode to " << mNode << " failed";
+            mWrittenMode = -1;
+            return false;
+        }
+
+        mWrittenMode = mMode;
+        return true;
+    }
+
+    void watch() {
+        alignas(struct inotify_event) char buf[4096];
+        const struct inotify_event* event;
+        ssize_t len;
+
+        for (;;) {
+            len = TEMP_FAILURE_RETRY(read(mInotifyFd, buf, sizeof(buf)));
+            if (len <= 0) {
+                PLOG(ERROR) << "read inotify events failed";
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mLock);
+            for (char* ptr = buf; ptr < buf + len; ptr += sizeof(*event) + event->len) {
+                event = reinterpret_cast<const struct inotify_event*>(ptr);
+                if (event->len == 0)
+                    continue;
+
+                if ((event->mask & IN_DELETE) && mFd >= 0 && mNode == event->name) {
+                    close(mFd);
+                    mFd = -1;
+                    mWrittenMode = -1;
+                }
+            }
+
+            // nothing to restore until DT2W has been set once
+            if (mFd >= 0 || mMode < 0)
+                continue;
+
+            mFd = open_ts_input(&mNode);
+            if (mFd >= 0)
+                writeMode();
+        }
+    }
+
+    std::mutex mLock;
+    int mFd;
+    std::string mNode;
+    // requested and last written wakeup mode, -1 when none
+    int mMode;
+    int mWrittenMode;
+    int mInotifyFd;
+};
+
+/*
+ * With persist.vendor.power.camera_profiling set, logs how long each camera
+ * streaming profile was in effect and the DDR bandwidth the CPU voted for
+ * meanwhile, taken from the cpubw devfreq residency. Lined up with the
+ * frame drops reported by the camera, this shows whether a profile's floor
+ * and zones hold the frame rate.
+ */
+class CameraProfiler {
+  public:
+    static CameraProfiler& getInstance() {
+        static CameraProfiler instance;
+        return instance;
+    }
+
+    void update(const std::string& profile) {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::map<uint64_t, uint64_t> residency;
+
+        if (profile == mProfile ||
+                !::android::base::GetBoolProperty("persist.vendor.power.camera_profiling", false))
+            return;
+
+        if (isCamera(mProfile) && readResidency(&residency))
+            report(residency);
+
+        mProfile = profile;
+        if (isCamera(mProfile) && !readResidency(&mStart))
+            mProfile.clear();
+    }
+
+  private:
+    static constexpr const char* kTransStat = "/sys/class/devfreq/soc:qcom,cpubw/trans_stat";
+
+    static bool isCamera(const std::string& profile) {
+        return ::android::base::StartsWith(profile, "camera_");
+    }
+
+    // time in ms spent at each frequency, from the rows of trans_stat
+    static bool readResidency(std::map<uint64_t, uint64_t>* residency) {
+        std::string content;
+
+        if (!::android::base::ReadFileToString(kTransStat, &content)) {
+            PLOG(ERROR) << "read " << kTransStat << " failed";
+            return false;
+        }
+
+        residency->clear();
+        for (const std::string& raw : ::android::base::Split(content, "\n")) {
+            std::string line = ::android::base::Trim(raw);
+            size_t colon = line.find(':');
+            size_t last = line.find_last_of(' ');
+            const char* freq;
+
+            if (colon == std::string::npos || last == std::string::npos || last < colon)
+                continue;
+
+            freq = line.c_str() + line.find_first_not_of(" *");
+            if (*freq < '0' || *freq > '9')
+                continue;
+
+            (*residency)[strtoull(freq, NULL, 10)] = strtoull(line.c_str() + last + 1, NULL, 10);
+        }
+
+        return !residency->empty();
+    }
+
+    void report(const std::map<uint64_t, uint64_t>& residency) {
+        uint64_t totalMs = 0, weighted = 0, topMs = 0;
+
+        for (const auto& entry : residency) {
+            auto start = mStart.find(entry.first);
+            uint64_t ms = entry.second;
+
+            // the stats may have been reset in between
+            if (start != mStart.end() && start->second <= ms)
+                ms -= start->second;
+
+            totalMs += ms;
+            weighted += entry.first * ms;
+            topMs = ms;
+        }
+
+        if (totalMs == 0)
+            return;
+
+        LOG(INFO) << "camera profile " << mProfile << ": " << totalMs << " ms, average cpubw "
+                  << weighted / totalMs << " MBps, " << topMs * 100 / totalMs
+                  << "% at the highest level";
+    }
+
+    std::mutex mLock;
+    std::string mProfile;
+    std::map<uint64_t, uint64_t> mStart;
+};
 }  // anonymous namespace
 
 namespace aidl {
@@ -65,11 +293,33 @@ namespace impl {
 static constexpr int kInputEventWakeupModeOff = 4;
 static constexpr int kInputEventWakeupModeOn = 5;
 
+/*
+ * Claiming LAUNCH here keeps the QTI HAL from sending its own launch hint to
+ * perfd, so the launch profile and kLaunchBoost stand in for it. perfd still
+ * boosts the same nodes for the hints the QTI HAL keeps, INTERACTION among
+ * them, which its extension doesn't pass on to this file. Whichever of the
+ * two ends a boost first restores the static tuning under the other.
+ */
+// the framework ends LAUNCH itself, this only bounds a lost release
+static constexpr int32_t kLaunchBoostMaxMs = 5000;
+// little and big cluster min freq, top-app schedtune boost
+static constexpr BoostLevel kLaunchBoost = {1766400, 2323200, 30};
+
 using ::aidl::android::hardware::power::Mode;
 
+static void setProfileMode(ProfileMode mode, bool enabled) {
+    CameraProfiler::getInstance().update(PowerProfiles::getInstance().setMode(mode, enabled));
+}
+
 bool isDeviceSpecificModeSupported(Mode type, bool* _aidl_return) {
     switch (type) {
         case Mode::DOUBLE_TAP_TO_WAKE:
+        case Mode::LOW_POWER:
+        case Mode::CAMERA_STREAMING_SECURE:
+        case Mode::CAMERA_STREAMING_LOW:
+        case Mode::CAMERA_STREAMING_MID:
+        case Mode::CAMERA_STREAMING_HIGH:
+        case Mode::LAUNCH:
             *_aidl_return = true;
             return true;
         default:
@@ -79,20 +329,36 @@ bool isDeviceSpecificModeSupported(Mode type, bool* _aidl_return) {
 
 bool setDeviceSpecificMode(Mode type, bool enabled) {
     switch (type) {
-        case Mode::DOUBLE_TAP_TO_WAKE: {
-            int fd = open_ts_input();
-            if (fd == -1) {
+        case Mode::DOUBLE_TAP_TO_WAKE:
+            if (!TouchscreenInput::getInstance().setWakeupMode(
+                        enabled ? kInputEventWakeupModeOn : kInputEventWakeupModeOff)) {
                 LOG(WARNING)
                     << "DT2W won't work because no supported touchscreen input devices were found";
                 return false;
             }
-            struct input_event ev;
-            ev.type = EV_SYN;
-            ev.code = SYN_CONFIG;
-            ev.value = enabled ? kInputEventWakeupModeOn : kInputEventWakeupModeOff;
-            write(fd, &ev, sizeof(ev));
-            close(fd);
-        }
+            return true;
+        case Mode::LOW_POWER:
+            setProfileMode(PROFILE_LOW_POWER, enabled);
+            return true;
+        case Mode::CAMERA_STREAMING_SECURE:
+            setProfileMode(PROFILE_CAMERA_SECURE, enabled);
+            return true;
+        case Mode::CAMERA_STREAMING_LOW:
+            setProfileMode(PROFILE_CAMERA_LOW, enabled);
+            return true;
+        case Mode::CAMERA_STREAMING_MID:
+            setProfileMode(PROFILE_CAMERA_MID, enabled);
+            return true;
+        case Mode::CAMERA_STREAMING_HIGH:
+            setProfileMode(PROFILE_CAMERA_HIGH, enabled);
+            return true;
+        case Mode::LAUNCH:
+            setProfileMode(PROFILE_LAUNCH, enabled);
+            if (enabled)
+                BoostEngine::getInstance().request(BOOST_SOURCE_LAUNCH, kLaunchBoost,
+                                                   kLaunchBoostMaxMs);
+            else
+                BoostEngine::getInstance().release(BOOST_SOURCE_LAUNCH);
             return true;
         default:
             return false;
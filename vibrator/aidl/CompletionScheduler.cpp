@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "vendor.qti.vibrator"
+
+#include <errno.h>
+#include <log/log.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iterator>
+
+#include "include/CompletionScheduler.h"
+#include "include/VibratorStats.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+#define NSEC_PER_MSEC           1000000LL
+#define NSEC_PER_SEC            1000000000LL
+
+static int64_t nowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+CompletionScheduler::CompletionScheduler()
+    : mDeadlineNs(0), mAction(NULL), mActionCtx(NULL), mActionDeadlineNs(0) {
+    mPending.reserve(kMaxCallbacks);
+    mFiring.reserve(kMaxCallbacks);
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mTimerFd < 0)
+        ALOGE("timerfd_create failed, errno = %d", errno);
+
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mWakeFd < 0)
+        ALOGE("eventfd failed, errno = %d", errno);
+
+    mThread = std::thread(&CompletionScheduler::run, this);
+}
+
+CompletionScheduler::~CompletionScheduler() {
+    uint64_t one = 1;
+
+    TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one)));
+    if (mThread.joinable())
+        mThread.join();
+
+    close(mTimerFd);
+    close(mWakeFd);
+}
+
+/* Must be called with mLock held; arms the timer for the earliest pending deadline. */
+void CompletionScheduler::rearm() {
+    struct itimerspec its = {};
+    int64_t deadlineNs = mPending.empty() ? 0 : mDeadlineNs;
+
+    if (mActionDeadlineNs != 0 && (deadlineNs == 0 || mActionDeadlineNs < deadlineNs))
+        deadlineNs = mActionDeadlineNs;
+
+    /* a zero it_value disarms the timer */
+    its.it_value.tv_sec = deadlineNs / NSEC_PER_SEC;
+    its.it_value.tv_nsec = deadlineNs % NSEC_PER_SEC;
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        ALOGE("timerfd_settime failed, errno = %d", errno);
+}
+
+/*
+ * Make callbacks the completions of an effect ending delayMs from now, dropping
+ * the ones still pending. The vector is swapped rather than copied, so the
+ * caller gets the dropped callbacks back and neither side allocates.
+ */
+void CompletionScheduler::schedule(Callbacks *callbacks, uint32_t delayMs) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mPending.swap(*callbacks);
+    /* keep the deadline non-zero so it can't be mistaken for a disarmed timer */
+    mDeadlineNs = nowNs() + delayMs * NSEC_PER_MSEC + 1;
+    rearm();
+}
+
+/* Add callbacks to the completions of the playing effect, or fire them now if it already ended. */
+void CompletionScheduler::join(Callbacks *callbacks) {
+    std::lock_guard<std::mutex> lock(mLock);
+    int64_t now = nowNs();
+
+    if (callbacks->empty())
+        return;
+
+    mPending.insert(mPending.end(), std::make_move_iterator(callbacks->begin()),
+                    std::make_move_iterator(callbacks->end()));
+    callbacks->clear();
+    if (now >= mDeadlineNs)
+        mDeadlineNs = now;
+    rearm();
+}
+
+void CompletionScheduler::cancel() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mPending.empty())
+        return;
+
+    mPending.clear();
+    rearm();
+}
+
+void CompletionScheduler::scheduleAction(Action action, void *ctx, uint32_t delayMs) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mAction = action;
+    mActionCtx = ctx;
+    mActionDeadlineNs = nowNs() + delayMs * NSEC_PER_MSEC + 1;
+    rearm();
+}
+
+void CompletionScheduler::cancelAction() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mAction == NULL)
+        return;
+
+    mAction = NULL;
+    mActionCtx = NULL;
+    mActionDeadlineNs = 0;
+    rearm();
+}
+
+void CompletionScheduler::run() {
+    struct pollfd fds[2];
+    uint64_t expirations;
+    int ret;
+
+    fds[0].fd = mTimerFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = mWakeFd;
+    fds[1].events = POLLIN;
+
+    while (true) {
+        ret = TEMP_FAILURE_RETRY(poll(fds, 2, -1));
+        if (ret == -1) {
+            ALOGE("poll failed, errno = %d", errno);
+            return;
+        }
+
+        if (fds[1].revents & POLLIN)
+            return;
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        /* EAGAIN here means the timer was re-armed after it expired */
+        if (read(mTimerFd, &expirations, sizeof(expirations)) == -1)
+            continue;
+
+        Action action = NULL;
+        void *actionCtx = NULL;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            int64_t now = nowNs();
+
+            /* a newer command may have moved the deadlines since the expiry */
+            if (mAction != NULL && now >= mActionDeadlineNs) {
+                action = mAction;
+                actionCtx = mActionCtx;
+                mAction = NULL;
+                mActionCtx = NULL;
+                mActionDeadlineNs = 0;
+            }
+            if (!mPending.empty() && now >= mDeadlineNs) {
+                vibratorStats().callbackLateness.record((now - mDeadlineNs) / 1000);
+                mFiring.swap(mPending);
+            }
+            rearm();
+        }
+
+        if (action != NULL)
+            action(actionCtx);
+
+        for (const auto& callback : mFiring) {
+            DEBUG_LOGD("Notifying vibration complete");
+            if (!callback->onComplete().isOk())
+                ALOGE("Failed to call onComplete");
+        }
+        mFiring.clear();
+    }
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
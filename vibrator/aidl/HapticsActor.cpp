@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "vendor.qti.vibrator"
+
+#include <cutils/properties.h>
+#include <errno.h>
+#include <log/log.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "include/HapticsActor.h"
+#include "include/Vibrator.h"
+#include "include/VibratorStats.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+// default burst window, a little longer than one single pulse effect
+#define BURST_WINDOW_MS         40
+
+static int64_t nowMs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+HapticsActor::HapticsActor(InputFFDevice *ff, LedVibratorDevice *led,
+                           CompletionScheduler *completions)
+    : mFF(ff), mLed(led), mCompletions(completions), mExit(false), mProbed(false), mBurstEffect(Effect::CLICK), mBurstMagnitude(0),
+      mBurstEndMs(0) {
+    // 0 disables burst coalescing
+    mBurstWindowMs = property_get_int32("ro.vendor.vibrator.burst_window_ms", BURST_WINDOW_MS);
+
+    for (size_t i = 0; i < kEffectCount; i++) {
+        for (int j = 0; j < kStrengthCount; j++)
+            mPlayLengthMs[i][j].store(effectPlayLengthMs(kEffects[i]), std::memory_order_relaxed);
+    }
+
+    mCarried.reserve(CompletionScheduler::kMaxCallbacks);
+
+    mWakeFd = eventfd(0, EFD_CLOEXEC);
+    if (mWakeFd < 0)
+        ALOGE("eventfd failed, errno = %d", errno);
+
+    mThread = std::thread(&HapticsActor::run, this);
+}
+
+HapticsActor::~HapticsActor() {
+    uint64_t one = 1;
+
+    mExit = true;
+    TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one)));
+    if (mThread.joinable())
+        mThread.join();
+
+    close(mWakeFd);
+}
+
+int HapticsActor::post(const HapticsCommand& cmd) {
+    uint64_t one = 1;
+
+    if (!mQueue.push(cmd)) {
+        ALOGE("haptics command queue is full, dropping command %d", cmd.type);
+        vibratorStats().queueFull.fetch_add(1, std::memory_order_relaxed);
+        return -EAGAIN;
+    }
+
+    if (TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one))) == -1) {
+        ALOGE("wake haptics actor failed, errno = %d", errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+// block until the actor has probed the haptics devices
+void HapticsActor::waitProbed() {
+    if (mProbed)
+        return;
+
+    std::unique_lock<std::mutex> lock(mProbeLock);
+    mProbeCond.wait(lock, [this] { return mProbed.load(); });
+}
+
+/*
+ * Play length of a supported effect. The registry's value is used until the
+ * FF driver reports its own, as its patterns may be tuned differently.
+ */
+long HapticsActor::playLengthMs(Effect effect, EffectStrength strength) {
+    const EffectInfo *info = findEffect(effect);
+
+    return mPlayLengthMs[info - kEffects][static_cast<int>(strength)]
+            .load(std::memory_order_relaxed);
+}
+
+bool HapticsActor::supersedes(const HapticsCommand& later, const HapticsCommand& cmd) {
+    if (cmd.type == HapticsCommand::AMPLITUDE)
+        return later.type == HapticsCommand::AMPLITUDE;
+
+    // a weaker effect doesn't cut a stronger one short
+    if (cmd.type == HapticsCommand::PERFORM && later.type == HapticsCommand::PERFORM)
+        return strengthMagnitude(later.strength) >= strengthMagnitude(cmd.strength);
+
+    return later.type != HapticsCommand::AMPLITUDE;
+}
+
+/*
+ * Whether an effect request arriving at nowMs merges into the one that is
+ * playing: the same effect at no more strength, or any weaker effect, while
+ * the playing one is within both its play length and the burst window.
+ */
+bool HapticsActor::inBurst(const HapticsCommand& cmd, int64_t nowMs) {
+    int16_t magnitude = strengthMagnitude(cmd.strength);
+
+    if (nowMs >= mBurstEndMs)
+        return false;
+
+    if (cmd.effect == mBurstEffect)
+        return magnitude <= mBurstMagnitude;
+
+    return magnitude < mBurstMagnitude;
+}
+
+int HapticsActor::apply(const HapticsCommand& cmd, long *playLengthMs) {
+    int ret;
+
+    *playLengthMs = 0;
+
+    // anything else stops or replaces the playing effect
+    if (cmd.type != HapticsCommand::PERFORM && cmd.type != HapticsCommand::AMPLITUDE)
+        mBurstEndMs = 0;
+
+    switch (cmd.type) {
+    case HapticsCommand::ON:
+        *playLengthMs = cmd.timeoutMs;
+        return mLed->mDetected ? mLed->on(cmd.timeoutMs) : mFF->on(cmd.timeoutMs);
+    case HapticsCommand::OFF:
+        return mLed->mDetected ? mLed->off() : mFF->off();
+    case HapticsCommand::PERFORM: {
+        EffectPlan plan = planEffect(cmd.effect, cmd.strength);
+        int64_t now = nowMs();
+
+        if (inBurst(cmd, now)) {
+            vibratorStats().coalesced.fetch_add(1, std::memory_order_relaxed);
+            return -EALREADY;
+        }
+
+        if (mLed->mDetected) {
+            ret = mLed->playEffect(plan, playLengthMs);
+        } else {
+            ret = mFF->playEffect(plan, playLengthMs);
+            if (ret == 0 && *playLengthMs > 0)
+                mPlayLengthMs[plan.info - kEffects][static_cast<int>(cmd.strength)]
+                        .store(*playLengthMs, std::memory_order_relaxed);
+        }
+
+        if (ret == 0 && mBurstWindowMs > 0) {
+            mBurstEffect = cmd.effect;
+            mBurstMagnitude = plan.magnitude;
+            mBurstEndMs = now + std::min<int64_t>(*playLengthMs, mBurstWindowMs);
+        } else {
+            mBurstEndMs = 0;
+        }
+        return ret;
+    }
+    case HapticsCommand::AMPLITUDE:
+        return mFF->setAmplitude(cmd.amplitude);
+    }
+
+    return -EINVAL;
+}
+
+void HapticsActor::run() {
+    uint64_t count;
+    size_t n, i, j;
+    long playLengthMs;
+    int ret;
+
+    mFF->probe();
+    mLed->probe();
+    {
+        std::lock_guard<std::mutex> lock(mProbeLock);
+        mProbed = true;
+    }
+    mProbeCond.notify_all();
+
+    while (!mExit) {
+        if (TEMP_FAILURE_RETRY(read(mWakeFd, &count, sizeof(count))) == -1) {
+            ALOGE("wait for haptics commands failed, errno = %d", errno);
+            return;
+        }
+
+        for (n = 0; n < kQueueSize && mQueue.pop(&mBatch[n]); n++)
+            ;
+
+        for (i = 0; i < n; i++) {
+            HapticsCommand& cmd = mBatch[i];
+            bool superseded = false;
+
+            for (j = i + 1; j < n && !superseded; j++)
+                superseded = supersedes(mBatch[j], cmd);
+            if (superseded) {
+                vibratorStats().coalesced.fetch_add(1, std::memory_order_relaxed);
+                if (cmd.callback != nullptr)
+                    mCarried.push_back(std::move(cmd.callback));
+                continue;
+            }
+
+            ret = apply(cmd, &playLengthMs);
+            if (cmd.callback != nullptr)
+                mCarried.push_back(std::move(cmd.callback));
+
+            if (ret == -EALREADY) {
+                // folded into the playing effect, complete along with it
+                mCompletions->join(&mCarried);
+            } else {
+                if (ret != 0) {
+                    ALOGE("haptics command %d failed, ret = %d", cmd.type, ret);
+                    vibratorStats().driverErrors.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                // replaces the pending completions, the old ones come back and are dropped
+                if (cmd.type != HapticsCommand::AMPLITUDE) {
+                    mCompletions->schedule(&mCarried, playLengthMs);
+                    mCarried.clear();
+                }
+            }
+        }
+    }
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -34,23 +34,22 @@
 #include <inttypes.h>
 #include <linux/input.h>
 #include <log/log.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "include/Vibrator.h"
-#ifdef USE_EFFECT_STREAM
 #include "effect.h"
-#endif
 
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
 
-#define STRONG_MAGNITUDE        0x7fff
-#define MEDIUM_MAGNITUDE        0x5fff
-#define LIGHT_MAGNITUDE         0x3fff
 #define INVALID_VALUE           -1
 #define CUSTOM_DATA_LEN         3
 #define NAME_BUF_SIZE           32
@@ -64,31 +63,12 @@ namespace vibrator {
 
 #define test_bit(bit, array)    ((array)[(bit)/8] & (1<<((bit)%8)))
 
-// all Xiaomi SDM845 vibrators have 4878 as WAVE_PLAY_RATE_US
-#define WAVE_PLAY_RATE_US       4878
-// from LED based QPNP Haptics driver
-#define HAP_WAVE_SAMP_LEN       8
-// sleep duration for double click
-#define DOUBLE_CLICK_SLEEP_MS   100
-
-// based on get_play_length() function from upstream qti-haptics driver
-static const long dummyPlayMs = WAVE_PLAY_RATE_US * HAP_WAVE_SAMP_LEN / 1000;
-static const long dummyDoubleClickPlayMs = WAVE_PLAY_RATE_US * HAP_WAVE_SAMP_LEN / 1000 * 2 + DOUBLE_CLICK_SLEEP_MS;
-
+static const char INPUT_DIR[] = "/dev/input/";
 static const char LED_DEVICE[] = "/sys/class/leds/vibrator";
+static const char INPUT_DEVICE_PROP[] = "persist.vendor.vibrator.input_device";
 
-InputFFDevice::InputFFDevice()
-{
-    DIR *dp;
-    FILE *fp = NULL;
-    struct dirent *dir;
-    uint8_t ffBitmask[FF_CNT / 8];
-    char devicename[PATH_MAX];
-    const char *INPUT_DIR = "/dev/input/";
-    char name[NAME_BUF_SIZE];
-    int fd, ret;
-    int soc = property_get_int32("ro.vendor.qti.soc_id", -1);
-
+InputFFDevice::InputFFDevice(const std::string& inputDir)
+    : mInputDir(inputDir) {
     mVibraFd = INVALID_VALUE;
     mSupportGain = false;
     mSupportEffects = false;
@@ -96,80 +76,120 @@ InputFFDevice::InputFFDevice()
     mCurrAppId = INVALID_VALUE;
     mCurrMagnitude = 0x7fff;
     mInExternalControl = false;
+    mLoadedEffectId = INVALID_VALUE;
+    mLoadedMagnitude = 0;
+    mLoadedPlayLengthMs = 0;
+    mPlayRateHz = property_get_int32("ro.vendor.vibrator.play_rate_hz", 0);
+}
+
+/*
+ * Find the haptics input device. The node found on a previous boot is kept
+ * in INPUT_DEVICE_PROP and tried first, so normally a single node is opened;
+ * the whole directory is only scanned when the device has moved. Nodes in
+ * any other directory, as injected by tests, are never cached.
+ */
+void InputFFDevice::probe() {
+    DIR *dp;
+    struct dirent *dir;
+    char devicename[PATH_MAX];
+    char cached[PROPERTY_VALUE_MAX] = "";
+    bool cache = mInputDir == INPUT_DIR;
 
-    dp = opendir(INPUT_DIR);
+    if (cache && property_get(INPUT_DEVICE_PROP, cached, "") > 0 &&
+            probeNode(cached) == 0)
+        return;
+
+    dp = opendir(mInputDir.c_str());
     if (!dp) {
-        ALOGE("open %s failed, errno = %d", INPUT_DIR, errno);
+        ALOGE("open %s failed, errno = %d", mInputDir.c_str(), errno);
         return;
     }
 
-    memset(ffBitmask, 0, sizeof(ffBitmask));
     while ((dir = readdir(dp)) != NULL){
         if (dir->d_name[0] == '.' &&
             (dir->d_name[1] == '\0' ||
              (dir->d_name[1] == '.' && dir->d_name[2] == '\0')))
             continue;
 
-        snprintf(devicename, PATH_MAX, "%s%s", INPUT_DIR, dir->d_name);
-        fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
-        if (fd < 0) {
-            ALOGE("open %s failed, errno = %d", devicename, errno);
+        snprintf(devicename, PATH_MAX, "%s%s", mInputDir.c_str(), dir->d_name);
+        if (strcmp(devicename, cached) == 0)
             continue;
-        }
 
-        ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGNAME(sizeof(name)), name));
-        if (ret == -1) {
-            ALOGE("get input device name %s failed, errno = %d\n", devicename, errno);
-            close(fd);
-            continue;
+        if (probeNode(devicename) == 0) {
+            if (cache)
+                property_set(INPUT_DEVICE_PROP, devicename);
+            break;
         }
+    }
 
-        if (strcmp(name, "qcom-hv-haptics") && strcmp(name, "qti-haptics")) {
-            ALOGD("not a qcom/qti haptics device\n");
-            close(fd);
-            continue;
-        }
+    closedir(dp);
+}
 
-        ALOGI("%s is detected at %s\n", name, devicename);
-        ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBitmask)), ffBitmask));
-        if (ret == -1) {
-            ALOGE("ioctl failed, errno = %d", errno);
-            close(fd);
-            continue;
-        }
+int InputFFDevice::probeNode(const char *devicename) {
+    FILE *fp = NULL;
+    uint8_t ffBitmask[FF_CNT / 8];
+    char name[NAME_BUF_SIZE];
+    int fd, ret;
+    int soc = property_get_int32("ro.vendor.qti.soc_id", -1);
 
-        if (test_bit(FF_CONSTANT, ffBitmask) ||
-                test_bit(FF_PERIODIC, ffBitmask)) {
-            mVibraFd = fd;
-            if (test_bit(FF_CUSTOM, ffBitmask))
-                mSupportEffects = true;
-            if (test_bit(FF_GAIN, ffBitmask))
-                mSupportGain = true;
-
-            if (soc <= 0 && (fp = fopen("/sys/devices/soc0/soc_id", "r")) != NULL) {
-                fscanf(fp, "%u", &soc);
-                fclose(fp);
-            }
-            switch (soc) {
-            case MSM_CPU_LAHAINA:
-            case APQ_CPU_LAHAINA:
-            case MSM_CPU_SHIMA:
-            case MSM_CPU_SM8325:
-            case APQ_CPU_SM8325P:
-            case MSM_CPU_YUPIK:
-                mSupportExternalControl = true;
-                break;
-            default:
-                mSupportExternalControl = false;
-                break;
-            }
-            break;
-        }
+    fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
+    if (fd < 0) {
+        ALOGE("open %s failed, errno = %d", devicename, errno);
+        return -errno;
+    }
 
+    ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGNAME(sizeof(name)), name));
+    if (ret == -1) {
+        ALOGE("get input device name %s failed, errno = %d\n", devicename, errno);
         close(fd);
+        return -errno;
     }
 
-    closedir(dp);
+    if (strcmp(name, "qcom-hv-haptics") && strcmp(name, "qti-haptics")) {
+        ALOGD("not a qcom/qti haptics device\n");
+        close(fd);
+        return -ENODEV;
+    }
+
+    ALOGI("%s is detected at %s\n", name, devicename);
+    memset(ffBitmask, 0, sizeof(ffBitmask));
+    ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBitmask)), ffBitmask));
+    if (ret == -1) {
+        ALOGE("ioctl failed, errno = %d", errno);
+        close(fd);
+        return -errno;
+    }
+
+    if (!test_bit(FF_CONSTANT, ffBitmask) && !test_bit(FF_PERIODIC, ffBitmask)) {
+        close(fd);
+        return -ENODEV;
+    }
+
+    mVibraFd = fd;
+    if (test_bit(FF_CUSTOM, ffBitmask))
+        mSupportEffects = true;
+    if (test_bit(FF_GAIN, ffBitmask))
+        mSupportGain = true;
+
+    if (soc <= 0 && (fp = fopen("/sys/devices/soc0/soc_id", "r")) != NULL) {
+        fscanf(fp, "%u", &soc);
+        fclose(fp);
+    }
+    switch (soc) {
+    case MSM_CPU_LAHAINA:
+    case APQ_CPU_LAHAINA:
+    case MSM_CPU_SHIMA:
+    case MSM_CPU_SM8325:
+    case APQ_CPU_SM8325P:
+    case MSM_CPU_YUPIK:
+        mSupportExternalControl = true;
+        break;
+    default:
+        mSupportExternalControl = false;
+        break;
+    }
+
+    return 0;
 }
 
 /** Play vibration
@@ -189,15 +209,17 @@ InputFFDevice::InputFFDevice()
  *                    The effect-ID is used for passing down the predefined effect to
  *                    kernel driver, and the rest two parameters are used for returning
  *                    back the real playing length from kernel driver.
+ *  @param stream:    optional waveform samples for the effect. If not NULL, the stream
+ *                    is passed down in custom_data instead of the effect-ID triplet and
+ *                    the playing length is calculated from its length and play rate.
  */
-int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
+int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs,
+                        const struct effect_stream *stream) {
     struct ff_effect effect;
     struct input_event play;
+    struct timespec start;
     int16_t data[CUSTOM_DATA_LEN] = {0, 0, 0};
     int ret;
-#ifdef USE_EFFECT_STREAM
-    const struct effect_stream *stream;
-#endif
 
     /* For QMAA compliance, return OK even if vibrator device doesn't exist */
     if (mVibraFd == INVALID_VALUE) {
@@ -206,6 +228,9 @@ int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
             return 0;
     }
 
+    /* whatever is uploaded below replaces the last predefined effect */
+    mLoadedEffectId = INVALID_VALUE;
+
     if (timeoutMs != 0) {
         if (mCurrAppId != INVALID_VALUE) {
             ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCRMFF, mCurrAppId));
@@ -224,13 +249,11 @@ int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
             effect.u.periodic.magnitude = mCurrMagnitude;
             effect.u.periodic.custom_data = data;
             effect.u.periodic.custom_len = sizeof(int16_t) * CUSTOM_DATA_LEN;
-#ifdef USE_EFFECT_STREAM
-            stream = get_effect_stream(effectId);
             if (stream != NULL) {
+                effect.u.periodic.magnitude = STRONG_MAGNITUDE;
                 effect.u.periodic.custom_data = (int16_t *)stream;
                 effect.u.periodic.custom_len = sizeof(*stream);
             }
-#endif
         } else {
             effect.type = FF_CONSTANT;
             effect.u.constant.level = mCurrMagnitude;
@@ -240,19 +263,19 @@ int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
         effect.id = mCurrAppId;
         effect.replay.delay = 0;
 
+        clock_gettime(CLOCK_MONOTONIC, &start);
         ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCSFF, &effect));
         if (ret == -1) {
             ALOGE("ioctl EVIOCSFF failed, errno = %d", -errno);
             goto errout;
         }
+        vibratorStats().upload.record(elapsedUs(start));
 
         mCurrAppId = effect.id;
         if (effectId != INVALID_VALUE && playLengthMs != NULL) {
             *playLengthMs = data[1] * 1000 + data[2];
-#ifdef USE_EFFECT_STREAM
             if (stream != NULL && stream->play_rate_hz != 0)
                 *playLengthMs = ((stream->length * 1000) / stream->play_rate_hz) + 1;
-#endif
         }
 
         play.value = 1;
@@ -260,7 +283,9 @@ int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
         play.code = mCurrAppId;
         play.time.tv_sec = 0;
         play.time.tv_usec = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
         ret = TEMP_FAILURE_RETRY(write(mVibraFd, (const void*)&play, sizeof(play)));
+        vibratorStats().play.record(elapsedUs(start));
         if (ret == -1) {
             ALOGE("write failed, errno = %d\n", -errno);
             ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCRMFF, mCurrAppId));
@@ -283,12 +308,71 @@ errout:
     return ret;
 }
 
+int InputFFDevice::writePlay(int16_t id, int32_t value) {
+    struct input_event play;
+    struct timespec start;
+    int ret;
+
+    play.value = value;
+    play.type = EV_FF;
+    play.code = id;
+    play.time.tv_sec = 0;
+    play.time.tv_usec = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = TEMP_FAILURE_RETRY(write(mVibraFd, (const void*)&play, sizeof(play)));
+    if (ret == -1) {
+        ALOGE("write failed, errno = %d\n", -errno);
+        return ret;
+    }
+    if (value != 0)
+        vibratorStats().play.record(elapsedUs(start));
+
+    return 0;
+}
+
+/** Play a predefined effect, replaying it if it is still uploaded
+ *
+ *  The driver keeps a single play state per chip, so only the most recently
+ *  uploaded effect can be started again with a bare EV_FF write. The effect
+ *  ID and magnitude of the last predefined effect are remembered along with
+ *  the playing length returned by the driver at upload time; anything else
+ *  goes through a new upload, which forgets them.
+ */
+int InputFFDevice::playCached(int effectId, long *playLengthMs) {
+    long length = 0;
+    int ret;
+
+    if (mVibraFd != INVALID_VALUE && mLoadedEffectId == effectId &&
+            mLoadedMagnitude == mCurrMagnitude) {
+        if (writePlay(mCurrAppId, 1) == 0) {
+            if (playLengthMs != NULL)
+                *playLengthMs = mLoadedPlayLengthMs;
+            return 0;
+        }
+    }
+
+    ret = play(effectId, INVALID_VALUE, &length, renderEffect(effectId));
+    if (ret == 0 && mCurrAppId != INVALID_VALUE) {
+        mLoadedEffectId = effectId;
+        mLoadedMagnitude = mCurrMagnitude;
+        mLoadedPlayLengthMs = length;
+    }
+
+    if (playLengthMs != NULL)
+        *playLengthMs = length;
+    return ret;
+}
+
 int InputFFDevice::on(int32_t timeoutMs) {
-    return play(INVALID_VALUE, timeoutMs, NULL);
+    return play(INVALID_VALUE, timeoutMs, NULL, NULL);
 }
 
 int InputFFDevice::off() {
-    return play(INVALID_VALUE, 0, NULL);
+    /* stop a predefined effect but keep it uploaded for replaying */
+    if (mVibraFd != INVALID_VALUE && mLoadedEffectId != INVALID_VALUE)
+        return writePlay(mCurrAppId, 0);
+
+    return play(INVALID_VALUE, 0, NULL, NULL);
 }
 
 int InputFFDevice::setAmplitude(uint8_t amplitude) {
@@ -315,51 +399,89 @@ int InputFFDevice::setAmplitude(uint8_t amplitude) {
     return 0;
 }
 
-int InputFFDevice::playEffect(int effectId, EffectStrength es, long *playLengthMs) {
-    switch (es) {
-    case EffectStrength::LIGHT:
-        mCurrMagnitude = LIGHT_MAGNITUDE;
-        break;
-    case EffectStrength::MEDIUM:
-        mCurrMagnitude = MEDIUM_MAGNITUDE;
-        break;
-    case EffectStrength::STRONG:
-        mCurrMagnitude = STRONG_MAGNITUDE;
-        break;
-    default:
-        return -1;
-    }
+int InputFFDevice::playEffect(const EffectPlan& plan, long *playLengthMs) {
+    mCurrMagnitude = plan.magnitude;
 
-    return play(effectId, INVALID_VALUE, playLengthMs);
+    return playCached(plan.info->ffEffectId, playLengthMs);
 }
 
-LedVibratorDevice::LedVibratorDevice() {
-    char devicename[PATH_MAX];
-    int fd;
+/*
+ * Render the waveform of a predefined effect at the current magnitude and at
+ * the configured play rate, so a single authored waveform covers every
+ * strength. Returns NULL if the effect is played from the driver's own
+ * pattern table instead.
+ */
+const struct effect_stream *InputFFDevice::renderEffect(int effectId) {
+#ifdef USE_EFFECT_STREAM
+    const struct effect_stream *src;
+    uint16_t gain;
+
+    src = get_effect_stream(effectId);
+    if (src == NULL)
+        return NULL;
+
+    gain = mCurrMagnitude * EFFECT_GAIN_UNITY / STRONG_MAGNITUDE;
+    if (effect_render(src, gain, mPlayRateHz, mRenderBuf, sizeof(mRenderBuf), &mRendered) != 0) {
+        ALOGE("effect %d doesn't fit in the render buffer", effectId);
+        return NULL;
+    }
+
+    return &mRendered;
+#else
+    (void)effectId;
+    return NULL;
+#endif
+}
 
+LedVibratorDevice::LedVibratorDevice(CompletionScheduler *sequencer, const std::string& ledDir)
+    : mSequencer(sequencer), mLedDir(ledDir) {
     mDetected = false;
+    mActivateFd = INVALID_VALUE;
+    mStateFd = INVALID_VALUE;
+    mDurationFd = INVALID_VALUE;
+    mDuration = INVALID_VALUE;
+    mStateOn = false;
+    mGeneration = 0;
+    mPulseGeneration = 0;
+    mPulseTimeoutMs = 0;
+}
 
-    snprintf(devicename, sizeof(devicename), "%s/%s", LED_DEVICE, "activate");
-    fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
-    if (fd < 0) {
-        ALOGE("open %s failed, errno = %d", devicename, errno);
+void LedVibratorDevice::probe() {
+    mActivateFd = open_attr(mLedDir.c_str(), "activate");
+    if (mActivateFd < 0)
+        return;
+
+    mStateFd = open_attr(mLedDir.c_str(), "state");
+    mDurationFd = open_attr(mLedDir.c_str(), "duration");
+    if (mStateFd < 0 || mDurationFd < 0) {
+        if (mStateFd >= 0)
+            close(mStateFd);
+        if (mDurationFd >= 0)
+            close(mDurationFd);
+        close(mActivateFd);
+        mActivateFd = mStateFd = mDurationFd = INVALID_VALUE;
         return;
     }
 
     mDetected = true;
 }
 
-int LedVibratorDevice::write_value(const char *file, const char *value) {
+int LedVibratorDevice::open_attr(const char *dir, const char *attr) {
+    char file[PATH_MAX];
     int fd;
-    int ret;
 
-    fd = TEMP_FAILURE_RETRY(open(file, O_WRONLY));
-    if (fd < 0) {
+    snprintf(file, sizeof(file), "%s/%s", dir, attr);
+    fd = TEMP_FAILURE_RETRY(open(file, O_WRONLY | O_CLOEXEC));
+    if (fd < 0)
         ALOGE("open %s failed, errno = %d", file, errno);
-        return -errno;
-    }
 
-    ret = TEMP_FAILURE_RETRY(write(fd, value, strlen(value) + 1));
+    return fd;
+}
+
+int LedVibratorDevice::write_value(int fd, const char *value) {
+    int ret;
+
+    ret = TEMP_FAILURE_RETRY(pwrite(fd, value, strlen(value) + 1, 0));
     if (ret == -1) {
         ret = -errno;
     } else if (ret != strlen(value) + 1) {
@@ -373,29 +495,37 @@ int LedVibratorDevice::write_value(const char *file, const char *value) {
     }
 
     errno = 0;
-    close(fd);
 
     return ret;
 }
 
-int LedVibratorDevice::on(int32_t timeoutMs) {
-    char file[PATH_MAX];
+/*
+ * Start one pulse. state and duration are latched by the driver, so they are
+ * only written when they differ from what was last written; activate is the
+ * trigger and is written every time. Must be called with mLock held.
+ */
+int LedVibratorDevice::pulse(int32_t timeoutMs) {
     char value[32];
     int ret;
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "state");
-    ret = write_value(file, "1");
-    if (ret < 0)
-       goto error;
+    if (!mStateOn) {
+        ret = write_value(mStateFd, "1");
+        if (ret < 0)
+           goto error;
+        mStateOn = true;
+    }
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "duration");
-    snprintf(value, sizeof(value), "%u\n", timeoutMs);
-    ret = write_value(file, value);
-    if (ret < 0)
-       goto error;
+    if (mDuration != timeoutMs) {
+        snprintf(value, sizeof(value), "%u\n", timeoutMs);
+        ret = write_value(mDurationFd, value);
+        if (ret < 0) {
+            mDuration = INVALID_VALUE;
+            goto error;
+        }
+        mDuration = timeoutMs;
+    }
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "activate");
-    ret = write_value(file, "1");
+    ret = write_value(mActivateFd, "1");
     if (ret < 0)
        goto error;
 
@@ -406,47 +536,88 @@ error:
     return ret;
 }
 
+void LedVibratorDevice::pulseAction(void *ctx) {
+    LedVibratorDevice *dev = static_cast<LedVibratorDevice *>(ctx);
+    std::lock_guard<std::mutex> lock(dev->mLock);
+
+    /* superseded by a command that arrived after the sequence was started */
+    if (dev->mPulseGeneration != dev->mGeneration)
+        return;
+
+    dev->pulse(dev->mPulseTimeoutMs);
+}
+
+int LedVibratorDevice::on(int32_t timeoutMs) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mGeneration++;
+    mSequencer->cancelAction();
+    return pulse(timeoutMs);
+}
+
 int LedVibratorDevice::off()
 {
-    char file[PATH_MAX];
-    int ret;
+    std::lock_guard<std::mutex> lock(mLock);
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "activate");
-    ret = write_value(file, "0");
-    return ret;
+    mGeneration++;
+    mSequencer->cancelAction();
+    return write_value(mActivateFd, "0");
 }
 
-int LedVibratorDevice::playEffect(Effect effect, long *playLengthMs) {
-    // default to the second effect in the predefined effect array
-    int32_t timeoutMs = 6;
+int LedVibratorDevice::playEffect(const EffectPlan& plan, long *playLengthMs) {
+    int32_t timeoutMs = plan.info->ledTimeoutMs;
+    std::lock_guard<std::mutex> lock(mLock);
 
-    *playLengthMs = dummyPlayMs;
+    *playLengthMs = plan.playLengthMs;
 
-    // QPNP haptics driver calculates the index as timeoutMs / 5
-    if (effect == Effect::CLICK || effect == Effect::DOUBLE_CLICK || effect == Effect::THUD || effect == Effect::POP) {
-        timeoutMs = 6;
-    } else if (effect == Effect::TICK) {
-        timeoutMs = 1;
-    } else if (effect == Effect::HEAVY_CLICK) {
-        timeoutMs = 11;
+    mGeneration++;
+    mSequencer->cancelAction();
+
+    // the second pulse of a double click is started by the sequencer
+    if (plan.info->pulses > 1) {
+        mPulseGeneration = mGeneration;
+        mPulseTimeoutMs = timeoutMs;
+        mSequencer->scheduleAction(&LedVibratorDevice::pulseAction, this, DOUBLE_CLICK_SLEEP_MS);
     }
 
-    // vibrate twice for double click
-    if (effect == Effect::DOUBLE_CLICK) {
-        on(timeoutMs);
-        usleep(DOUBLE_CLICK_SLEEP_MS * 1000);
-        *playLengthMs = dummyDoubleClickPlayMs;
+    return pulse(timeoutMs);
+}
+
+Vibrator::Vibrator() : Vibrator(INPUT_DIR, LED_DEVICE) {
+}
+
+Vibrator::Vibrator(const std::string& inputDir, const std::string& ledDir)
+    : ff(inputDir), ledVib(&mCompletions, ledDir), mActor(&ff, &ledVib, &mCompletions) {
+}
+
+static int64_t nowMs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+void Vibrator::trackExternalControl(bool enabled) {
+    VibratorStats& stats = vibratorStats();
+
+    if (enabled) {
+        stats.externalControlSinceMs = nowMs();
+        return;
     }
 
-    return on(timeoutMs);
+    int64_t since = stats.externalControlSinceMs.exchange(0);
+    if (since != 0)
+        stats.externalControlMs.fetch_add(nowMs() - since, std::memory_order_relaxed);
 }
 
 ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
+    mActor.waitProbed();
+
     *_aidl_return = IVibrator::CAP_ON_CALLBACK;
 
     if (ledVib.mDetected) {
         *_aidl_return |= IVibrator::CAP_PERFORM_CALLBACK;
-        ALOGD("QTI Vibrator reporting capabilities: %d", *_aidl_return);
+        DEBUG_LOGD("QTI Vibrator reporting capabilities: %d", *_aidl_return);
         return ndk::ScopedAStatus::ok();
     }
 
@@ -457,18 +628,17 @@ ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
     if (ff.mSupportExternalControl)
         *_aidl_return |= IVibrator::CAP_EXTERNAL_CONTROL;
 
-    ALOGD("QTI Vibrator reporting capabilities: %d", *_aidl_return);
+    DEBUG_LOGD("QTI Vibrator reporting capabilities: %d", *_aidl_return);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::off() {
+    HapticsCommand cmd = {};
     int ret;
 
-    ALOGD("QTI Vibrator off");
-    if (ledVib.mDetected)
-        ret = ledVib.off();
-    else
-        ret = ff.off();
+    DEBUG_LOGD("QTI Vibrator off");
+    cmd.type = HapticsCommand::OFF;
+    ret = mActor.post(cmd);
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
@@ -477,81 +647,66 @@ ndk::ScopedAStatus Vibrator::off() {
 
 ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
                                 const std::shared_ptr<IVibratorCallback>& callback) {
+    HapticsCommand cmd = {};
     int ret;
 
-    ALOGD("Vibrator on for timeoutMs: %d", timeoutMs);
-    if (ledVib.mDetected)
-        ret = ledVib.on(timeoutMs);
-    else
-        ret = ff.on(timeoutMs);
-
+    DEBUG_LOGD("Vibrator on for timeoutMs: %d", timeoutMs);
+    cmd.type = HapticsCommand::ON;
+    cmd.timeoutMs = timeoutMs;
+    cmd.callback = callback;
+    ret = mActor.post(cmd);
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
-    if (callback != nullptr) {
-        std::thread([=] {
-            ALOGD("Starting on on another thread");
-            usleep(timeoutMs * 1000);
-            ALOGD("Notifying on complete");
-            if (!callback->onComplete().isOk()) {
-                ALOGE("Failed to call onComplete");
-            }
-        }).detach();
-    }
+    vibratorStats().ons.fetch_add(1, std::memory_order_relaxed);
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength es, const std::shared_ptr<IVibratorCallback>& callback, int32_t* _aidl_return) {
+    HapticsCommand cmd = {};
     long playLengthMs;
     int ret;
 
-    ALOGD("Vibrator perform effect %d", effect);
+    DEBUG_LOGD("Vibrator perform effect %d", effect);
 
-    if (effect < Effect::CLICK ||
-            effect > Effect::HEAVY_CLICK)
+    if (planEffect(effect, es).info == NULL)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    if (es != EffectStrength::LIGHT && es != EffectStrength::MEDIUM && es != EffectStrength::STRONG)
-        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
-
-    if (ledVib.mDetected) {
-        ret = ledVib.playEffect(effect, &playLengthMs);
-    } else {
-        ret = ff.playEffect((static_cast<int>(effect)), es, &playLengthMs);
-    }
-
+    cmd.type = HapticsCommand::PERFORM;
+    cmd.effect = effect;
+    cmd.strength = es;
+    cmd.callback = callback;
+    playLengthMs = mActor.playLengthMs(effect, es);
+    ret = mActor.post(cmd);
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
-    if (callback != nullptr) {
-        std::thread([=] {
-            ALOGD("Starting perform on another thread");
-            usleep(playLengthMs * 1000);
-            ALOGD("Notifying perform complete");
-            callback->onComplete();
-        }).detach();
-    }
+    vibratorStats().performs[findEffect(effect) - kEffects][static_cast<int>(es)]
+            .fetch_add(1, std::memory_order_relaxed);
 
     *_aidl_return = playLengthMs;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::getSupportedEffects(std::vector<Effect>* _aidl_return) {
-    *_aidl_return = {Effect::CLICK, Effect::DOUBLE_CLICK, Effect::TICK, Effect::THUD,
-                     Effect::POP, Effect::HEAVY_CLICK};
+    _aidl_return->clear();
+    for (const EffectInfo& info : kEffects)
+        _aidl_return->push_back(info.effect);
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
-    uint8_t tmp;
+    HapticsCommand cmd = {};
     int ret;
 
+    mActor.waitProbed();
+
     if (ledVib.mDetected)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    ALOGD("Vibrator set amplitude: %f", amplitude);
+    DEBUG_LOGD("Vibrator set amplitude: %f", amplitude);
 
     if (amplitude <= 0.0f || amplitude > 1.0f)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
@@ -559,23 +714,29 @@ ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
     if (ff.mInExternalControl)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    tmp = (uint8_t)(amplitude * 0xff);
-    ret = ff.setAmplitude(tmp);
+    cmd.type = HapticsCommand::AMPLITUDE;
+    cmd.amplitude = (uint8_t)(amplitude * 0xff);
+    ret = mActor.post(cmd);
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
+    vibratorStats().amplitudes.fetch_add(1, std::memory_order_relaxed);
+
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::setExternalControl(bool enabled) {
+    mActor.waitProbed();
+
     if (ledVib.mDetected)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    ALOGD("Vibrator set external control: %d", enabled);
+    DEBUG_LOGD("Vibrator set external control: %d", enabled);
     if (!ff.mSupportExternalControl)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    ff.mInExternalControl = enabled;
+    if (ff.mInExternalControl.exchange(enabled) != enabled)
+        trackExternalControl(enabled);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -614,8 +775,23 @@ ndk::ScopedAStatus Vibrator::alwaysOnDisable(int32_t id __unused) {
     return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 }
 
+binder_status_t Vibrator::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    mActor.waitProbed();
+
+    dprintf(fd, "QTI vibrator:\n");
+    if (ledVib.mDetected) {
+        dprintf(fd, "  backend: LED vibrator\n");
+    } else {
+        dprintf(fd, "  backend: input FF, gain %d, effects %d, external control %d\n",
+                ff.mSupportGain, ff.mSupportEffects, ff.mSupportExternalControl);
+        dprintf(fd, "  in external control: %d\n", ff.mInExternalControl.load());
+    }
+    vibratorStats().dump(fd);
+
+    return STATUS_OK;
+}
+
 }  // namespace vibrator
 }  // namespace hardware
 }  // namespace android
 }  // namespace aidl
-
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "include/VibratorStats.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+static const char *kStrengthNames[] = {"light", "medium", "strong"};
+
+VibratorStats& vibratorStats() {
+    static VibratorStats stats;
+    return stats;
+}
+
+int64_t elapsedUs(const struct timespec& start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000000LL + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+void LatencyHistogram::record(int64_t us) {
+    int bucket = 0;
+    int64_t max = mMaxUs.load(std::memory_order_relaxed);
+
+    if (us < 0)
+        us = 0;
+
+    // bucket 0 is < 16 us, every further bucket doubles
+    for (int64_t limit = 16; us >= limit && bucket < kBuckets - 1; limit <<= 1)
+        bucket++;
+
+    mCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+    mTotalUs.fetch_add(us, std::memory_order_relaxed);
+    while (us > max && !mMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::dump(int fd, const char *name) const {
+    uint64_t count = 0;
+
+    for (int i = 0; i < kBuckets; i++)
+        count += mCounts[i].load(std::memory_order_relaxed);
+
+    dprintf(fd, "  %s: %" PRIu64 " samples", name, count);
+    if (count == 0) {
+        dprintf(fd, "\n");
+        return;
+    }
+
+    dprintf(fd, ", avg %" PRIu64 " us, max %" PRId64 " us\n   ",
+            mTotalUs.load(std::memory_order_relaxed) / count,
+            mMaxUs.load(std::memory_order_relaxed));
+    for (int i = 0; i < kBuckets; i++) {
+        uint32_t n = mCounts[i].load(std::memory_order_relaxed);
+
+        if (n == 0)
+            continue;
+        if (i == kBuckets - 1)
+            dprintf(fd, " >=%dus:%u", 16 << (i - 1), n);
+        else
+            dprintf(fd, " <%dus:%u", 16 << i, n);
+    }
+    dprintf(fd, "\n");
+}
+
+void VibratorStats::dump(int fd) const {
+    struct timespec ts;
+    int64_t externalMs = externalControlMs.load(std::memory_order_relaxed);
+    int64_t sinceMs = externalControlSinceMs.load(std::memory_order_relaxed);
+
+    if (sinceMs != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        externalMs += ts.tv_sec * 1000LL + ts.tv_nsec / 1000000 - sinceMs;
+    }
+
+    dprintf(fd, "Effects:\n");
+    for (size_t i = 0; i < kEffectCount; i++) {
+        dprintf(fd, "  %s:", toString(kEffects[i].effect).c_str());
+        for (int j = 0; j < kStrengthCount; j++)
+            dprintf(fd, " %s %u", kStrengthNames[j],
+                    performs[i][j].load(std::memory_order_relaxed));
+        dprintf(fd, "\n");
+    }
+
+    dprintf(fd, "Commands:\n");
+    dprintf(fd, "  on: %u, amplitude: %u\n", ons.load(std::memory_order_relaxed),
+            amplitudes.load(std::memory_order_relaxed));
+    dprintf(fd, "  coalesced: %u\n", coalesced.load(std::memory_order_relaxed));
+    dprintf(fd, "Errors:\n");
+    dprintf(fd, "  driver: %u, queue full: %u\n", driverErrors.load(std::memory_order_relaxed),
+            queueFull.load(std::memory_order_relaxed));
+    dprintf(fd, "External control: %" PRId64 " ms%s\n", externalMs,
+            sinceMs != 0 ? " (active)" : "");
+
+    dprintf(fd, "Latency:\n");
+    upload.dump(fd, "effect upload");
+    play.dump(fd, "effect play");
+    callbackLateness.dump(fd, "callback lateness");
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
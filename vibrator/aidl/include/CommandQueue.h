@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/*
+ * Bounded lock-free multi-producer single-consumer ring. Every cell carries a
+ * sequence number telling producers and the consumer whose turn it is, so
+ * neither side ever takes a lock or allocates.
+ */
+template <typename T, size_t N>
+class CommandQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    CommandQueue() : mTail(0), mHead(0) {
+        for (size_t i = 0; i < N; i++)
+            mCells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // returns false if the ring is full
+    bool push(const T& value) {
+        size_t pos = mTail.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell *cell = &mCells[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0) {
+                if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell->value = value;
+                    cell->seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mTail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consumer side only, returns false if the ring is empty
+    bool pop(T *value) {
+        Cell *cell = &mCells[mHead & (N - 1)];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+
+        if ((intptr_t)seq - (intptr_t)(mHead + 1) < 0)
+            return false;
+
+        *value = std::move(cell->value);
+        cell->seq.store(mHead + N, std::memory_order_release);
+        mHead++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    Cell mCells[N];
+    alignas(64) std::atomic<size_t> mTail;
+    alignas(64) size_t mHead;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/vibrator/IVibratorCallback.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/*
+ * Owns the completion callbacks of the effect that is currently playing and
+ * fires them from a single timerfd driven thread. Every new command supersedes
+ * whatever completions are still pending, so stale callbacks never fire after
+ * a later on()/off()/perform() has taken over the actuator. Requests that were
+ * merged into the playing effect join its callbacks and complete with it.
+ *
+ * The same thread also runs the timed follow-up step of multi-pulse effects,
+ * so those no longer have to block the binder thread between pulses.
+ */
+class CompletionScheduler {
+public:
+    typedef void (*Action)(void *ctx);
+    typedef std::vector<std::shared_ptr<IVibratorCallback>> Callbacks;
+
+    // enough for a full batch of the actor's command queue
+    static constexpr size_t kMaxCallbacks = 64;
+
+    CompletionScheduler();
+    ~CompletionScheduler();
+    void schedule(Callbacks *callbacks, uint32_t delayMs);
+    void join(Callbacks *callbacks);
+    void cancel();
+    void scheduleAction(Action action, void *ctx, uint32_t delayMs);
+    void cancelAction();
+private:
+    void run();
+    void rearm();
+    int mTimerFd;
+    int mWakeFd;
+    std::mutex mLock;
+    Callbacks mPending;
+    // end of the playing effect, kept after its callbacks have fired
+    int64_t mDeadlineNs;
+    Action mAction;
+    void *mActionCtx;
+    int64_t mActionDeadlineNs;
+    // only touched by the timer thread
+    Callbacks mFiring;
+    std::thread mThread;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
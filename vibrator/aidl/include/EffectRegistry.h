@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/vibrator/Effect.h>
+#include <aidl/android/hardware/vibrator/EffectStrength.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+#define STRONG_MAGNITUDE        0x7fff
+#define MEDIUM_MAGNITUDE        0x5fff
+#define LIGHT_MAGNITUDE         0x3fff
+
+// all Xiaomi SDM845 vibrators have 4878 as WAVE_PLAY_RATE_US
+#define WAVE_PLAY_RATE_US       4878
+// from LED based QPNP Haptics driver
+#define HAP_WAVE_SAMP_LEN       8
+// sleep duration for double click
+#define DOUBLE_CLICK_SLEEP_MS   100
+
+/*
+ * Every predefined effect the HAL supports, with what each backend needs to
+ * play it. Everything here is constexpr, so supported effects, validation and
+ * play lengths are resolved at compile time instead of asking the driver.
+ */
+struct EffectInfo {
+    Effect effect;
+    // pattern index passed to the qti-haptics driver in custom_data[0]
+    int16_t ffEffectId;
+    // QPNP haptics driver calculates the pattern index as timeoutMs / 5
+    int32_t ledTimeoutMs;
+    // number of pulses, DOUBLE_CLICK_SLEEP_MS apart
+    int32_t pulses;
+};
+
+constexpr EffectInfo kEffects[] = {
+    {Effect::CLICK,        0, 6,  1},
+    {Effect::DOUBLE_CLICK, 1, 6,  2},
+    {Effect::TICK,         2, 1,  1},
+    {Effect::THUD,         3, 6,  1},
+    {Effect::POP,          4, 6,  1},
+    {Effect::HEAVY_CLICK,  5, 11, 1},
+};
+
+constexpr size_t kEffectCount = sizeof(kEffects) / sizeof(kEffects[0]);
+
+// based on get_play_length() function from upstream qti-haptics driver
+constexpr long kPulsePlayMs = WAVE_PLAY_RATE_US * HAP_WAVE_SAMP_LEN / 1000;
+
+// resolved effect and strength, info is NULL if the combination is unsupported
+struct EffectPlan {
+    const EffectInfo *info;
+    int16_t magnitude;
+    long playLengthMs;
+};
+
+constexpr const EffectInfo *findEffect(Effect effect) {
+    for (size_t i = 0; i < kEffectCount; i++) {
+        if (kEffects[i].effect == effect)
+            return &kEffects[i];
+    }
+
+    return NULL;
+}
+
+constexpr int16_t strengthMagnitude(EffectStrength strength) {
+    switch (strength) {
+    case EffectStrength::LIGHT:
+        return LIGHT_MAGNITUDE;
+    case EffectStrength::MEDIUM:
+        return MEDIUM_MAGNITUDE;
+    case EffectStrength::STRONG:
+        return STRONG_MAGNITUDE;
+    }
+
+    return 0;
+}
+
+constexpr long effectPlayLengthMs(const EffectInfo& info) {
+    return info.pulses * kPulsePlayMs + (info.pulses - 1) * DOUBLE_CLICK_SLEEP_MS;
+}
+
+constexpr EffectPlan planEffect(Effect effect, EffectStrength strength) {
+    const EffectInfo *info = findEffect(effect);
+    int16_t magnitude = strengthMagnitude(strength);
+
+    if (info == NULL || magnitude == 0)
+        return {NULL, 0, 0};
+
+    return {info, magnitude, effectPlayLengthMs(*info)};
+}
+
+static_assert(planEffect(Effect::CLICK, EffectStrength::LIGHT).playLengthMs == 39,
+              "single pulse effects play for one wave");
+static_assert(planEffect(Effect::DOUBLE_CLICK, EffectStrength::STRONG).playLengthMs == 178,
+              "double click plays two waves with a gap");
+static_assert(planEffect(Effect::RINGTONE_1, EffectStrength::STRONG).info == NULL,
+              "ringtones are not supported");
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
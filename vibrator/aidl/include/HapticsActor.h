@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/vibrator/Effect.h>
+#include <aidl/android/hardware/vibrator/EffectStrength.h>
+#include <aidl/android/hardware/vibrator/IVibratorCallback.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "CommandQueue.h"
+#include "CompletionScheduler.h"
+#include "EffectRegistry.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+class InputFFDevice;
+class LedVibratorDevice;
+
+struct HapticsCommand {
+    enum Type : uint8_t {
+        ON,
+        OFF,
+        PERFORM,
+        AMPLITUDE,
+    };
+
+    Type type;
+    int32_t timeoutMs;
+    Effect effect;
+    EffectStrength strength;
+    uint8_t amplitude;
+    // completion of ON and PERFORM, scheduled once the actor plays it
+    std::shared_ptr<IVibratorCallback> callback;
+};
+
+/*
+ * Single thread owning the haptics devices. Binder threads post commands into
+ * a lock-free ring and return; the actor applies them in order, dropping any
+ * command that a later one in the same batch already supersedes.
+ *
+ * The devices are probed on the actor too, so the service registers right
+ * away. Commands posted meanwhile simply queue up; calls that need to know
+ * what was found block in waitProbed().
+ *
+ * Predefined effects requested while a stronger or identical one is still
+ * within its burst window are dropped, so rapid-fire ticks and clicks don't
+ * reprogram the driver mid-playback. Completion callbacks are scheduled by
+ * the actor as each command is applied; the callback of a dropped or
+ * superseded request is carried over and fires along with the effect that
+ * took its place.
+ */
+class HapticsActor {
+public:
+    HapticsActor(InputFFDevice *ff, LedVibratorDevice *led, CompletionScheduler *completions);
+    ~HapticsActor();
+    int post(const HapticsCommand& cmd);
+    long playLengthMs(Effect effect, EffectStrength strength);
+    void waitProbed();
+private:
+    static constexpr size_t kQueueSize = 64;
+    static constexpr int kStrengthCount = static_cast<int>(EffectStrength::STRONG) + 1;
+
+    void run();
+    int apply(const HapticsCommand& cmd, long *playLengthMs);
+    bool supersedes(const HapticsCommand& later, const HapticsCommand& cmd);
+    bool inBurst(const HapticsCommand& cmd, int64_t nowMs);
+    InputFFDevice *mFF;
+    LedVibratorDevice *mLed;
+    CompletionScheduler *mCompletions;
+    CommandQueue<HapticsCommand, kQueueSize> mQueue;
+    HapticsCommand mBatch[kQueueSize];
+    // callbacks of superseded commands, waiting for the command that replaced them
+    CompletionScheduler::Callbacks mCarried;
+    // play lengths reported by the driver, seeded from the effect registry
+    std::atomic<long> mPlayLengthMs[kEffectCount][kStrengthCount];
+    std::atomic<bool> mExit;
+    std::atomic<bool> mProbed;
+    std::mutex mProbeLock;
+    std::condition_variable mProbeCond;
+    // effect currently playing, mBurstEndMs is 0 when there is none
+    Effect mBurstEffect;
+    int16_t mBurstMagnitude;
+    int64_t mBurstEndMs;
+    int32_t mBurstWindowMs;
+    int mWakeFd;
+    std::thread mThread;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
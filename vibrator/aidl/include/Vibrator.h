@@ -31,6 +31,15 @@
 
 #include <aidl/android/hardware/vibrator/BnVibrator.h>
 
+#include <atomic>
+#include <string>
+
+#include "CompletionScheduler.h"
+#include "EffectRegistry.h"
+#include "HapticsActor.h"
+#include "VibratorStats.h"
+#include "effect.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -38,35 +47,69 @@ namespace vibrator {
 
 class InputFFDevice {
 public:
-    InputFFDevice();
-    int playEffect(int effectId, EffectStrength es, long *playLengthMs);
+    InputFFDevice(const std::string& inputDir);
+    void probe();
+    int playEffect(const EffectPlan& plan, long *playLengthMs);
     int on(int32_t timeoutMs);
     int off();
     int setAmplitude(uint8_t amplitude);
     bool mSupportGain;
     bool mSupportEffects;
     bool mSupportExternalControl;
-    bool mInExternalControl;
+    std::atomic<bool> mInExternalControl;
 private:
-    int play(int effectId, uint32_t timeoutMs, long *playLengthMs);
+    static constexpr int kMaxRenderSamples = 1024;
+
+    int play(int effectId, uint32_t timeoutMs, long *playLengthMs,
+             const struct effect_stream *stream);
+    int probeNode(const char *devicename);
+    int playCached(int effectId, long *playLengthMs);
+    const struct effect_stream *renderEffect(int effectId);
+    int writePlay(int16_t id, int32_t value);
+    std::string mInputDir;
     int mVibraFd;
     int16_t mCurrAppId;
     int16_t mCurrMagnitude;
+    // last predefined effect uploaded into mCurrAppId, INVALID_VALUE if none
+    int mLoadedEffectId;
+    int16_t mLoadedMagnitude;
+    long mLoadedPlayLengthMs;
+    uint32_t mPlayRateHz;
+    struct effect_stream mRendered;
+    int8_t mRenderBuf[kMaxRenderSamples];
 };
 
 class LedVibratorDevice {
 public:
-    LedVibratorDevice();
+    LedVibratorDevice(CompletionScheduler *sequencer, const std::string& ledDir);
+    void probe();
     int on(int32_t timeoutMs);
     int off();
-    int playEffect(Effect effect, long *playLengthMs);
+    int playEffect(const EffectPlan& plan, long *playLengthMs);
     bool mDetected;
 private:
-    int write_value(const char *file, const char *value);
+    int open_attr(const char *dir, const char *attr);
+    int write_value(int fd, const char *value);
+    int pulse(int32_t timeoutMs);
+    static void pulseAction(void *ctx);
+    CompletionScheduler *mSequencer;
+    std::string mLedDir;
+    std::mutex mLock;
+    int mActivateFd;
+    int mStateFd;
+    int mDurationFd;
+    bool mStateOn;
+    int32_t mDuration;
+    uint32_t mGeneration;
+    uint32_t mPulseGeneration;
+    int32_t mPulseTimeoutMs;
 };
 
 class Vibrator : public BnVibrator {
 public:
+    Vibrator();
+    // probe the haptics devices under other roots, e.g. a uinput device and a fake LED tree
+    Vibrator(const std::string& inputDir, const std::string& ledDir);
     class InputFFDevice ff;
     class LedVibratorDevice ledVib;
     ndk::ScopedAStatus getCapabilities(int32_t* _aidl_return) override;
@@ -79,8 +122,8 @@ public:
     ndk::ScopedAStatus getSupportedEffects(std::vector<Effect>* _aidl_return) override;
     ndk::ScopedAStatus setAmplitude(float amplitude) override;
     ndk::ScopedAStatus setExternalControl(bool enabled) override;
-    ndk::ScopedAStatus getCompositionDelayMax(int32_t* maxDelayMs);
-    ndk::ScopedAStatus getCompositionSizeMax(int32_t* maxSize);
+    ndk::ScopedAStatus getCompositionDelayMax(int32_t* maxDelayMs) override;
+    ndk::ScopedAStatus getCompositionSizeMax(int32_t* maxSize) override;
     ndk::ScopedAStatus getSupportedPrimitives(std::vector<CompositePrimitive>* supported) override;
     ndk::ScopedAStatus getPrimitiveDuration(CompositePrimitive primitive,
                                             int32_t* durationMs) override;
@@ -89,6 +132,11 @@ public:
     ndk::ScopedAStatus getSupportedAlwaysOnEffects(std::vector<Effect>* _aidl_return) override;
     ndk::ScopedAStatus alwaysOnEnable(int32_t id, Effect effect, EffectStrength strength) override;
     ndk::ScopedAStatus alwaysOnDisable(int32_t id) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+private:
+    void trackExternalControl(bool enabled);
+    CompletionScheduler mCompletions;
+    HapticsActor mActor;
 };
 
 }  // namespace vibrator
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cutils/properties.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "EffectRegistry.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+// per-call logging costs logd throughput, so it is off unless asked for
+static inline bool vibratorDebug() {
+    static const bool debug = property_get_bool("persist.vendor.vibrator.debug", false);
+    return debug;
+}
+
+#define DEBUG_LOGD(...) do { if (vibratorDebug()) ALOGD(__VA_ARGS__); } while (0)
+
+// power of two buckets from under 16 us up to 65 ms and above
+class LatencyHistogram {
+public:
+    static constexpr int kBuckets = 14;
+
+    void record(int64_t us);
+    void dump(int fd, const char *name) const;
+private:
+    std::atomic<uint32_t> mCounts[kBuckets] = {};
+    std::atomic<uint64_t> mTotalUs = {0};
+    std::atomic<int64_t> mMaxUs = {0};
+};
+
+/*
+ * Counters reported by dumpsys. Everything is a relaxed atomic, so the
+ * binder threads, the haptics actor and the completion thread can update
+ * them without taking a lock.
+ */
+struct VibratorStats {
+    static constexpr int kStrengthCount = static_cast<int>(EffectStrength::STRONG) + 1;
+
+    std::atomic<uint32_t> performs[kEffectCount][kStrengthCount] = {};
+    std::atomic<uint32_t> ons = {0};
+    std::atomic<uint32_t> amplitudes = {0};
+    // commands dropped by batching or burst coalescing
+    std::atomic<uint32_t> coalesced = {0};
+    std::atomic<uint32_t> queueFull = {0};
+    std::atomic<uint32_t> driverErrors = {0};
+    std::atomic<int64_t> externalControlMs = {0};
+    // start of the current external control session, 0 when not in one
+    std::atomic<int64_t> externalControlSinceMs = {0};
+    LatencyHistogram upload;
+    LatencyHistogram play;
+    LatencyHistogram callbackLateness;
+
+    void dump(int fd) const;
+};
+
+VibratorStats& vibratorStats();
+int64_t elapsedUs(const struct timespec& start);
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
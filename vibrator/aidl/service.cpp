@@ -35,10 +35,15 @@
 
 #include "Vibrator.h"
 
+#define VIBRATOR_BINDER_THREADS 3
+
 using aidl::android::hardware::vibrator::Vibrator;
 
 int main() {
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    // device access is serialized by the haptics actor, so binder calls
+    // can be served concurrently
+    ABinderProcess_setThreadPoolMaxThreadCount(VIBRATOR_BINDER_THREADS);
+    ABinderProcess_startThreadPool();
     std::shared_ptr<Vibrator> vib = ndk::SharedRefBase::make<Vibrator>();
 
     const std::string instance = std::string() + Vibrator::descriptor + "/default";
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "vendor.qti.vibrator.benchmark"
+
+#include <aidl/android/hardware/vibrator/BnVibratorCallback.h>
+#include <android-base/file.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <inttypes.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Vibrator.h"
+
+using aidl::android::hardware::vibrator::BnVibratorCallback;
+using aidl::android::hardware::vibrator::Effect;
+using aidl::android::hardware::vibrator::EffectStrength;
+using aidl::android::hardware::vibrator::IVibrator;
+using aidl::android::hardware::vibrator::Vibrator;
+
+namespace {
+
+constexpr int kCalls = 1000;
+constexpr int kCallbackRuns = 50;
+constexpr int32_t kOnMs = 20;
+// calls posted before waiting for the actor, well inside its 64 command ring
+constexpr int kBatch = 16;
+// budgets a regression has to blow through to fail the suite
+constexpr int64_t kCallP99BudgetUs = 2000;
+constexpr int64_t kCallbackErrorP99BudgetUs = 10000;
+
+int64_t nowUs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// read and write syscalls made by the whole process so far, from /proc/self/io
+uint64_t rwSyscalls() {
+    std::string content;
+    uint64_t syscr = 0, syscw = 0;
+
+    if (!android::base::ReadFileToString("/proc/self/io", &content))
+        return 0;
+
+    for (const char *line = content.c_str(); line != NULL; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+        sscanf(line, "syscr: %" SCNu64, &syscr);
+        sscanf(line, "syscw: %" SCNu64, &syscw);
+    }
+
+    return syscr + syscw;
+}
+
+void reportLatency(const char *name, std::vector<int64_t> samples, int64_t budgetUs) {
+    int64_t p50, p99;
+
+    ASSERT_FALSE(samples.empty());
+    std::sort(samples.begin(), samples.end());
+    p50 = samples[(samples.size() - 1) * 50 / 100];
+    p99 = samples[(samples.size() - 1) * 99 / 100];
+
+    printf("%-28s p50 %6" PRId64 " us, p99 %6" PRId64 " us\n", name, p50, p99);
+    ::testing::Test::RecordProperty(std::string(name) + "_p50_us", std::to_string(p50));
+    ::testing::Test::RecordProperty(std::string(name) + "_p99_us", std::to_string(p99));
+    EXPECT_LE(p99, budgetUs) << name;
+}
+
+void reportPerCall(const char *name, uint64_t count, int calls) {
+    printf("%-28s %6.2f per call\n", name, (double)count / calls);
+    ::testing::Test::RecordProperty(name, std::to_string((double)count / calls));
+}
+
+class CompletionRecorder : public BnVibratorCallback {
+  public:
+    ndk::ScopedAStatus onComplete() override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mDoneUs = nowUs();
+        mCond.notify_all();
+        return ndk::ScopedAStatus::ok();
+    }
+
+    // time of the completion, 0 if it never came
+    int64_t wait() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCond.wait_for(lock, std::chrono::seconds(1), [this] { return mDoneUs != 0; });
+        return mDoneUs;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    int64_t mDoneUs = 0;
+};
+
+/*
+ * uinput device posing as the qti-haptics driver, linked into a temporary
+ * input directory so the HAL under test finds only this one. Uploads and
+ * erases are acknowledged from a service thread, and every operation that
+ * reaches the device is counted.
+ *
+ * uinput refuses FF_CUSTOM uploads, as it has no way to hand the samples to
+ * userspace. FF_CUSTOM is still advertised so the HAL takes its effect path,
+ * but only constant effects and gain changes get through to the device;
+ * predefined effects are timed end to end on the LED backend instead.
+ */
+class FakeHapticsDevice {
+  public:
+    ~FakeHapticsDevice() {
+        uint64_t one = 1;
+
+        if (mThread.joinable()) {
+            TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one)));
+            mThread.join();
+        }
+        if (mWakeFd >= 0)
+            close(mWakeFd);
+        if (mFd >= 0) {
+            ioctl(mFd, UI_DEV_DESTROY);
+            close(mFd);
+        }
+    }
+
+    bool create() {
+        struct uinput_setup setup = {};
+        char sysname[64];
+        std::string event;
+
+        mFd = TEMP_FAILURE_RETRY(open("/dev/uinput", O_RDWR | O_CLOEXEC));
+        if (mFd < 0)
+            return false;
+
+        ioctl(mFd, UI_SET_EVBIT, EV_FF);
+        ioctl(mFd, UI_SET_FFBIT, FF_CONSTANT);
+        ioctl(mFd, UI_SET_FFBIT, FF_PERIODIC);
+        ioctl(mFd, UI_SET_FFBIT, FF_CUSTOM);
+        ioctl(mFd, UI_SET_FFBIT, FF_GAIN);
+        snprintf(setup.name, sizeof(setup.name), "qti-haptics");
+        setup.id.bustype = BUS_VIRTUAL;
+        setup.ff_effects_max = 16;
+        if (ioctl(mFd, UI_DEV_SETUP, &setup) == -1 || ioctl(mFd, UI_DEV_CREATE) == -1)
+            return false;
+
+        if (ioctl(mFd, UI_GET_SYSNAME(sizeof(sysname)), sysname) == -1)
+            return false;
+
+        // ueventd creates the node asynchronously
+        for (int i = 0; i < 100 && event.empty(); i++) {
+            event = findEventNode(sysname);
+            if (event.empty() || access(("/dev/input/" + event).c_str(), F_OK) != 0) {
+                event.clear();
+                usleep(10000);
+            }
+        }
+        if (event.empty())
+            return false;
+
+        mInputDir = std::string(mDir.path) + "/";
+        if (symlink(("/dev/input/" + event).c_str(), (mInputDir + event).c_str()) == -1)
+            return false;
+
+        mWakeFd = eventfd(0, EFD_CLOEXEC);
+        if (mWakeFd < 0)
+            return false;
+        mThread = std::thread(&FakeHapticsDevice::run, this);
+        return true;
+    }
+
+    const std::string& inputDir() const { return mInputDir; }
+    uint32_t uploads() const { return mUploads; }
+    uint32_t erases() const { return mErases; }
+    uint32_t plays() const { return mPlays; }
+    uint32_t gains() const { return mGains; }
+
+  private:
+    static std::string findEventNode(const char *sysname) {
+        std::string dir = std::string("/sys/devices/virtual/input/") + sysname;
+        std::string event;
+        struct dirent *entry;
+        DIR *dp;
+
+        dp = opendir(dir.c_str());
+        if (dp == NULL)
+            return event;
+
+        while ((entry = readdir(dp)) != NULL) {
+            if (strncmp(entry->d_name, "event", strlen("event")) == 0) {
+                event = entry->d_name;
+                break;
+            }
+        }
+
+        closedir(dp);
+        return event;
+    }
+
+    void run() {
+        struct pollfd fds[2] = {{mFd, POLLIN, 0}, {mWakeFd, POLLIN, 0}};
+        struct input_event ev;
+
+        while (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) > 0 && !(fds[1].revents & POLLIN)) {
+            if (TEMP_FAILURE_RETRY(read(mFd, &ev, sizeof(ev))) != sizeof(ev))
+                continue;
+
+            if (ev.type == EV_UINPUT && ev.code == UI_FF_UPLOAD)
+                upload(ev.value);
+            else if (ev.type == EV_UINPUT && ev.code == UI_FF_ERASE)
+                erase(ev.value);
+            else if (ev.type == EV_FF && ev.code == FF_GAIN)
+                mGains++;
+            else if (ev.type == EV_FF)
+                mPlays++;
+        }
+    }
+
+    void upload(int32_t requestId) {
+        struct uinput_ff_upload upload = {};
+
+        upload.request_id = requestId;
+        if (ioctl(mFd, UI_BEGIN_FF_UPLOAD, &upload) == -1)
+            return;
+
+        upload.retval = 0;
+        ioctl(mFd, UI_END_FF_UPLOAD, &upload);
+        mUploads++;
+    }
+
+    void erase(int32_t requestId) {
+        struct uinput_ff_erase erase = {};
+
+        erase.request_id = requestId;
+        if (ioctl(mFd, UI_BEGIN_FF_ERASE, &erase) == -1)
+            return;
+
+        erase.retval = 0;
+        ioctl(mFd, UI_END_FF_ERASE, &erase);
+        mErases++;
+    }
+
+    android::base::TemporaryDir mDir;
+    std::string mInputDir;
+    int mFd = -1;
+    int mWakeFd = -1;
+    std::thread mThread;
+    std::atomic<uint32_t> mUploads{0};
+    std::atomic<uint32_t> mErases{0};
+    std::atomic<uint32_t> mPlays{0};
+    std::atomic<uint32_t> mGains{0};
+};
+
+class InputFFBenchmark : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        int32_t caps;
+
+        if (!mDevice.create())
+            GTEST_SKIP() << "uinput is not available, errno = " << errno;
+
+        mVibrator = ndk::SharedRefBase::make<Vibrator>(mDevice.inputDir(), "/nonexistent");
+        ASSERT_TRUE(mVibrator->getCapabilities(&caps).isOk());
+        ASSERT_TRUE(caps & IVibrator::CAP_AMPLITUDE_CONTROL);
+    }
+
+    // wait until the actor has applied everything posted so far, it applies in order
+    void drain() {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        ASSERT_TRUE(mVibrator->on(1, recorder).isOk());
+        ASSERT_NE(recorder->wait(), 0);
+    }
+
+    FakeHapticsDevice mDevice;
+    std::shared_ptr<Vibrator> mVibrator;
+};
+
+class LedBenchmark : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        int32_t caps;
+
+        for (const char *attr : {"activate", "state", "duration"})
+            ASSERT_TRUE(android::base::WriteStringToFile("0", std::string(mLedDir.path) + "/" + attr));
+
+        mVibrator = ndk::SharedRefBase::make<Vibrator>("/nonexistent/", mLedDir.path);
+        ASSERT_TRUE(mVibrator->getCapabilities(&caps).isOk());
+        ASSERT_TRUE(mVibrator->ledVib.mDetected);
+    }
+
+    android::base::TemporaryDir mLedDir;
+    std::shared_ptr<Vibrator> mVibrator;
+};
+
+}  // anonymous namespace
+
+TEST_F(InputFFBenchmark, On) {
+    std::vector<int64_t> latency, error;
+    uint32_t ops;
+    uint64_t syscalls;
+    int64_t start, done;
+
+    ops = mDevice.uploads() + mDevice.erases() + mDevice.plays();
+    syscalls = rwSyscalls();
+    for (int i = 0; i < kCalls; i += kBatch) {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        // the last call of a batch completes once the actor has applied all of it
+        for (int j = 0; j < kBatch; j++) {
+            start = nowUs();
+            ASSERT_TRUE(mVibrator->on(kOnMs, j == kBatch - 1 ? recorder : nullptr).isOk());
+            latency.push_back(nowUs() - start);
+        }
+        ASSERT_NE(recorder->wait(), 0);
+    }
+    reportLatency("on", latency, kCallP99BudgetUs);
+    reportPerCall("on_device_ops", mDevice.uploads() + mDevice.erases() + mDevice.plays() - ops,
+                  latency.size());
+    reportPerCall("on_rw_syscalls", rwSyscalls() - syscalls, latency.size());
+
+    for (int i = 0; i < kCallbackRuns; i++) {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        start = nowUs();
+        ASSERT_TRUE(mVibrator->on(kOnMs, recorder).isOk());
+        done = recorder->wait();
+        ASSERT_NE(done, 0);
+        error.push_back(std::abs(done - start - kOnMs * 1000));
+    }
+    reportLatency("on_callback_error", error, kCallbackErrorP99BudgetUs);
+}
+
+TEST_F(InputFFBenchmark, SetAmplitude) {
+    std::vector<int64_t> latency;
+    uint32_t gains;
+    uint64_t syscalls, drainSyscalls;
+    int64_t start;
+
+    // what the drains cost on their own, so it can be taken out of the per call figures
+    drainSyscalls = rwSyscalls();
+    for (int i = 0; i < kCalls; i += kBatch)
+        drain();
+    drainSyscalls = rwSyscalls() - drainSyscalls;
+
+    gains = mDevice.gains();
+    syscalls = rwSyscalls();
+    for (int i = 0; i < kCalls; i += kBatch) {
+        for (int j = 0; j < kBatch; j++) {
+            start = nowUs();
+            ASSERT_TRUE(mVibrator->setAmplitude(j % 2 ? 0.5f : 1.0f).isOk());
+            latency.push_back(nowUs() - start);
+        }
+        drain();
+    }
+    syscalls = rwSyscalls() - syscalls;
+    reportLatency("set_amplitude", latency, kCallP99BudgetUs);
+    reportPerCall("set_amplitude_device_ops", mDevice.gains() - gains, latency.size());
+    reportPerCall("set_amplitude_rw_syscalls", syscalls - std::min(syscalls, drainSyscalls),
+                  latency.size());
+}
+
+TEST_F(InputFFBenchmark, Perform) {
+    std::vector<int64_t> latency;
+    int32_t lengthMs;
+    int64_t start;
+
+    for (int i = 0; i < kCalls; i += kBatch) {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        for (int j = 0; j < kBatch; j++) {
+            start = nowUs();
+            ASSERT_TRUE(mVibrator->perform(j % 2 ? Effect::CLICK : Effect::TICK,
+                                           EffectStrength::MEDIUM,
+                                           j == kBatch - 1 ? recorder : nullptr,
+                                           &lengthMs).isOk());
+            latency.push_back(nowUs() - start);
+        }
+        ASSERT_NE(recorder->wait(), 0);
+    }
+    reportLatency("ff_perform", latency, kCallP99BudgetUs);
+}
+
+TEST_F(LedBenchmark, Perform) {
+    std::vector<int64_t> latency, error;
+    uint64_t syscalls;
+    int32_t lengthMs;
+    int64_t start, done;
+
+    syscalls = rwSyscalls();
+    for (int i = 0; i < kCalls; i += kBatch) {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        for (int j = 0; j < kBatch; j++) {
+            start = nowUs();
+            ASSERT_TRUE(mVibrator->perform(Effect::CLICK, EffectStrength::MEDIUM,
+                                           j == kBatch - 1 ? recorder : nullptr,
+                                           &lengthMs).isOk());
+            latency.push_back(nowUs() - start);
+        }
+        ASSERT_NE(recorder->wait(), 0);
+    }
+    reportLatency("led_perform", latency, kCallP99BudgetUs);
+    reportPerCall("led_perform_rw_syscalls", rwSyscalls() - syscalls, latency.size());
+
+    // the burst window ends with the effect, so every run is played
+    for (int i = 0; i < kCallbackRuns; i++) {
+        auto recorder = ndk::SharedRefBase::make<CompletionRecorder>();
+
+        start = nowUs();
+        ASSERT_TRUE(mVibrator->perform(Effect::CLICK, EffectStrength::MEDIUM, recorder,
+                                       &lengthMs).isOk());
+        done = recorder->wait();
+        ASSERT_NE(done, 0);
+        error.push_back(std::abs(done - start - lengthMs * 1000));
+    }
+    reportLatency("led_perform_callback_error", error, kCallbackErrorP99BudgetUs);
+}
+
+// requests merged into the playing effect, or superseded before it, complete with it
+TEST_F(LedBenchmark, MergedPerformsComplete) {
+    std::vector<std::shared_ptr<CompletionRecorder>> recorders;
+    int32_t lengthMs;
+
+    for (int i = 0; i < 8; i++) {
+        recorders.push_back(ndk::SharedRefBase::make<CompletionRecorder>());
+        ASSERT_TRUE(mVibrator->perform(Effect::CLICK, EffectStrength::MEDIUM, recorders.back(),
+                                       &lengthMs).isOk());
+    }
+
+    for (const auto& recorder : recorders)
+        EXPECT_NE(recorder->wait(), 0);
+}
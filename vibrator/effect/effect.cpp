@@ -27,6 +27,8 @@
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
+
 #include "effect.h"
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
@@ -51,22 +53,22 @@ static const int8_t effect_1[] = {
 static const struct effect_stream effects[] = {
     {
         .effect_id = 0,
-        .data = effect_0,
         .length = ARRAY_SIZE(effect_0),
         .play_rate_hz = 8000,
+        .data = effect_0,
     },
 
     {
         .effect_id = 1,
-        .data = effect_1,
         .length = ARRAY_SIZE(effect_1),
         .play_rate_hz = 8000,
+        .data = effect_1,
     },
 };
 
 const struct effect_stream *get_effect_stream(uint32_t effect_id)
 {
-    int i;
+    size_t i;
 
     for (i = 0; i < ARRAY_SIZE(effects); i++) {
         if (effect_id == effects[i].effect_id)
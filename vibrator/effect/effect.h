@@ -29,6 +29,7 @@
 
 #ifndef QTI_VIBRATOR_EFFECT_STREAM_H
 #define QTI_VIBRATOR_EFFECT_STREAM_H
+#include <stdint.h>
 #include <sys/types.h>
 
 struct effect_stream {
@@ -38,6 +39,21 @@ struct effect_stream {
     const int8_t    *data;
 };
 
+/* gains are Q14 fixed point, EFFECT_GAIN_MAX is just under 2.0 */
+#define EFFECT_GAIN_UNITY       (1 << 14)
+#define EFFECT_GAIN_MAX         0x7fff
+
 const struct effect_stream *get_effect_stream(uint32_t effect_id);
 
+/* scale count samples by gain, clamping to [-127, 127]; dst may alias src */
+void effect_scale(int8_t *dst, const int8_t *src, uint32_t count, uint16_t gain);
+/* number of samples src takes at play_rate_hz, 0 keeps the authored rate */
+uint32_t effect_render_length(const struct effect_stream *src, uint32_t play_rate_hz);
+/*
+ * Resample src to play_rate_hz and scale it by gain into buf, describing the
+ * result in dst. Returns 0 on success or -EINVAL if buf is too small.
+ */
+int effect_render(const struct effect_stream *src, uint16_t gain, uint32_t play_rate_hz,
+                  int8_t *buf, uint32_t buf_len, struct effect_stream *dst);
+
 #endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "effect.h"
+
+#define SAMPLE_MAX              127
+#define SAMPLE_MIN              (-127)
+
+/*
+ * All variants compute clamp((x * gain + 2^13) >> 14) so the vector and
+ * scalar paths produce bit-identical output.
+ */
+static inline int8_t scale_sample(int8_t x, uint16_t gain)
+{
+    int32_t v = ((int32_t)x * gain + (1 << 13)) >> 14;
+
+    if (v > SAMPLE_MAX)
+        v = SAMPLE_MAX;
+    else if (v < SAMPLE_MIN)
+        v = SAMPLE_MIN;
+
+    return (int8_t)v;
+}
+
+void effect_scale(int8_t *dst, const int8_t *src, uint32_t count, uint16_t gain)
+{
+    uint32_t i = 0;
+
+    if (gain > EFFECT_GAIN_MAX)
+        gain = EFFECT_GAIN_MAX;
+
+#if defined(__ARM_NEON)
+    const int16x4_t g = vdup_n_s16((int16_t)gain);
+    const int16x8_t lo = vdupq_n_s16(SAMPLE_MIN);
+
+    for (; i + 16 <= count; i += 16) {
+        int8x16_t x = vld1q_s8(src + i);
+        int16x8_t a = vmovl_s8(vget_low_s8(x));
+        int16x8_t b = vmovl_s8(vget_high_s8(x));
+
+        int16x8_t ra = vcombine_s16(vqrshrn_n_s32(vmull_s16(vget_low_s16(a), g), 14),
+                                    vqrshrn_n_s32(vmull_s16(vget_high_s16(a), g), 14));
+        int16x8_t rb = vcombine_s16(vqrshrn_n_s32(vmull_s16(vget_low_s16(b), g), 14),
+                                    vqrshrn_n_s32(vmull_s16(vget_high_s16(b), g), 14));
+
+        ra = vmaxq_s16(ra, lo);
+        rb = vmaxq_s16(rb, lo);
+        vst1q_s8(dst + i, vcombine_s8(vqmovn_s16(ra), vqmovn_s16(rb)));
+    }
+#elif defined(__SSE2__)
+    const __m128i g = _mm_set1_epi16((int16_t)gain);
+    const __m128i lo = _mm_set1_epi16(SAMPLE_MIN);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i sign = _mm_cmpgt_epi8(zero, x);
+        /* pre-shift by 2 so mulhi yields (x * gain) >> 14 */
+        __m128i a = _mm_slli_epi16(_mm_unpacklo_epi8(x, sign), 2);
+        __m128i b = _mm_slli_epi16(_mm_unpackhi_epi8(x, sign), 2);
+
+        /* round with bit 15 of the low half of the product */
+        __m128i ra = _mm_add_epi16(_mm_mulhi_epi16(a, g),
+                                   _mm_srli_epi16(_mm_mullo_epi16(a, g), 15));
+        __m128i rb = _mm_add_epi16(_mm_mulhi_epi16(b, g),
+                                   _mm_srli_epi16(_mm_mullo_epi16(b, g), 15));
+
+        ra = _mm_max_epi16(ra, lo);
+        rb = _mm_max_epi16(rb, lo);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi16(ra, rb));
+    }
+#endif
+
+    for (; i < count; i++)
+        dst[i] = scale_sample(src[i], gain);
+}
+
+uint32_t effect_render_length(const struct effect_stream *src, uint32_t play_rate_hz)
+{
+    if (play_rate_hz == 0 || play_rate_hz == src->play_rate_hz)
+        return src->length;
+
+    return ((uint64_t)src->length * play_rate_hz + src->play_rate_hz / 2) / src->play_rate_hz;
+}
+
+/*
+ * Linear interpolation in Q16 fixed point. The first and last samples are
+ * kept, so the waveform keeps its duration at the new play rate.
+ */
+static void resample(int8_t *dst, uint32_t dst_len, const int8_t *src, uint32_t src_len)
+{
+    uint64_t step, pos = 0;
+    uint32_t i, idx, frac;
+    int32_t a, b;
+
+    if (dst_len == 1 || src_len == 1) {
+        for (i = 0; i < dst_len; i++)
+            dst[i] = src[0];
+        return;
+    }
+
+    step = ((uint64_t)(src_len - 1) << 16) / (dst_len - 1);
+    for (i = 0; i < dst_len; i++, pos += step) {
+        idx = pos >> 16;
+        frac = pos & 0xffff;
+        if (idx >= src_len - 1) {
+            dst[i] = src[src_len - 1];
+            continue;
+        }
+
+        a = src[idx];
+        b = src[idx + 1];
+        dst[i] = (int8_t)(a + (((b - a) * (int32_t)frac + (1 << 15)) >> 16));
+    }
+}
+
+int effect_render(const struct effect_stream *src, uint16_t gain, uint32_t play_rate_hz,
+                  int8_t *buf, uint32_t buf_len, struct effect_stream *dst)
+{
+    uint32_t length = effect_render_length(src, play_rate_hz);
+
+    if (length == 0 || length > buf_len)
+        return -EINVAL;
+
+    if (length == src->length) {
+        effect_scale(buf, src->data, length, gain);
+    } else {
+        resample(buf, length, src->data, src->length);
+        effect_scale(buf, buf, length, gain);
+    }
+
+    dst->effect_id = src->effect_id;
+    dst->length = length;
+    dst->play_rate_hz = length == src->length ? src->play_rate_hz : play_rate_hz;
+    dst->data = buf;
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2022 The PixelExperience Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "effect.h"
+
+namespace {
+
+// every gain the kernels special-case or could round differently at
+const uint32_t kGains[] = {
+    0, 1, 2, 8191, 8192, 8193, EFFECT_GAIN_UNITY - 1, EFFECT_GAIN_UNITY,
+    EFFECT_GAIN_UNITY + 1, 24576, EFFECT_GAIN_MAX - 1, EFFECT_GAIN_MAX,
+    // above EFFECT_GAIN_MAX, clamped by effect_scale()
+    EFFECT_GAIN_MAX + 1, 0xffff,
+};
+
+// the scalar definition all the vector paths have to match
+int8_t referenceScale(int8_t x, uint16_t gain) {
+    int32_t v;
+
+    if (gain > EFFECT_GAIN_MAX)
+        gain = EFFECT_GAIN_MAX;
+
+    v = ((int32_t)x * gain + (1 << 13)) >> 14;
+    if (v > 127)
+        v = 127;
+    else if (v < -127)
+        v = -127;
+
+    return (int8_t)v;
+}
+
+// every int8 value, with the extremes at both ends of each vector block
+std::vector<int8_t> allSamples() {
+    std::vector<int8_t> samples = {-128, 127, -127, 0, 1, -1};
+
+    for (int x = -128; x <= 127; x++)
+        samples.push_back((int8_t)x);
+    samples.push_back(127);
+    samples.push_back(-128);
+
+    return samples;
+}
+
+}  // anonymous namespace
+
+// lengths around the 16 sample vector block, so both the vector body and the scalar tail run
+TEST(EffectScaleTest, MatchesScalarDefinition) {
+    std::vector<int8_t> all = allSamples();
+
+    for (uint32_t gain : kGains) {
+        for (size_t count : {(size_t)0, (size_t)1, (size_t)15, (size_t)16, (size_t)17,
+                             (size_t)31, (size_t)32, (size_t)33, all.size()}) {
+            std::vector<int8_t> dst(count + 1, 0x55);
+
+            effect_scale(dst.data(), all.data(), count, gain);
+            for (size_t i = 0; i < count; i++)
+                ASSERT_EQ(dst[i], referenceScale(all[i], gain))
+                        << "x " << (int)all[i] << " gain " << gain << " count " << count;
+            // nothing past count is touched
+            EXPECT_EQ(dst[count], 0x55);
+        }
+    }
+}
+
+TEST(EffectScaleTest, ScalesInPlace) {
+    std::vector<int8_t> all = allSamples();
+
+    for (uint32_t gain : kGains) {
+        std::vector<int8_t> buf = all;
+
+        effect_scale(buf.data(), buf.data(), buf.size(), gain);
+        for (size_t i = 0; i < buf.size(); i++)
+            ASSERT_EQ(buf[i], referenceScale(all[i], gain)) << "gain " << gain;
+    }
+}
+
+TEST(EffectScaleTest, ClampsSymmetrically) {
+    int8_t src[32], dst[32];
+
+    for (int i = 0; i < 32; i++)
+        src[i] = i % 2 ? 127 : -128;
+
+    effect_scale(dst, src, 32, EFFECT_GAIN_MAX);
+    for (int i = 0; i < 32; i++)
+        EXPECT_EQ(dst[i], i % 2 ? 127 : -127);
+
+    effect_scale(dst, src, 32, 0);
+    for (int i = 0; i < 32; i++)
+        EXPECT_EQ(dst[i], 0);
+
+    effect_scale(dst, src, 32, EFFECT_GAIN_UNITY);
+    for (int i = 0; i < 32; i++)
+        EXPECT_EQ(dst[i], i % 2 ? 127 : -127);
+}
+
+TEST(EffectRenderTest, KeepsAuthoredRate) {
+    const struct effect_stream *src = get_effect_stream(0);
+    struct effect_stream dst;
+    int8_t buf[256];
+
+    ASSERT_NE(src, nullptr);
+    ASSERT_EQ(effect_render(src, EFFECT_GAIN_UNITY, 0, buf, sizeof(buf), &dst), 0);
+    EXPECT_EQ(dst.length, src->length);
+    EXPECT_EQ(dst.play_rate_hz, src->play_rate_hz);
+    for (uint32_t i = 0; i < src->length; i++)
+        EXPECT_EQ(buf[i], referenceScale(src->data[i], EFFECT_GAIN_UNITY));
+}
+
+TEST(EffectRenderTest, ResamplesToPlayRate) {
+    const struct effect_stream *src = get_effect_stream(0);
+    struct effect_stream dst;
+    int8_t buf[256];
+
+    ASSERT_NE(src, nullptr);
+    ASSERT_EQ(effect_render(src, EFFECT_GAIN_UNITY, src->play_rate_hz * 2, buf, sizeof(buf),
+                            &dst), 0);
+    EXPECT_EQ(dst.length, effect_render_length(src, src->play_rate_hz * 2));
+    EXPECT_EQ(dst.length, src->length * 2);
+    EXPECT_EQ(dst.play_rate_hz, src->play_rate_hz * 2);
+    // the end points are kept
+    EXPECT_EQ(buf[0], src->data[0]);
+    EXPECT_EQ(buf[dst.length - 1], src->data[src->length - 1]);
+}
+
+TEST(EffectRenderTest, RejectsSmallBuffer) {
+    const struct effect_stream *src = get_effect_stream(0);
+    struct effect_stream dst;
+    int8_t buf[8];
+
+    ASSERT_NE(src, nullptr);
+    EXPECT_EQ(effect_render(src, EFFECT_GAIN_UNITY, 0, buf, sizeof(buf), &dst), -EINVAL);
+}